@@ -61,6 +61,7 @@
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/nsproxy.h>
+#include <linux/percpu.h>
 #include <linux/poll.h>
 #include <linux/debugfs.h>
 #include <linux/rbtree.h>
@@ -247,6 +248,44 @@ static inline void binder_stats_created(enum binder_stat_types type)
 }
 #endif
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+enum binder_lat_types {
+	BINDER_LAT_QUEUE,	/* queued on target to BR_TRANSACTION */
+	BINDER_LAT_DISPATCH,	/* BC_TRANSACTION to BR_TRANSACTION */
+	BINDER_LAT_REPLY,	/* BC_TRANSACTION to matching BC_REPLY */
+	BINDER_LAT_COUNT
+};
+
+/*
+ * Bucket i counts latencies in [2^i, 2^(i+1)) usecs; bucket 0 also takes
+ * everything below 1 usec and the last bucket everything above.
+ */
+#define BINDER_LAT_BUCKETS	16
+
+struct binder_lat_hist {
+	u64 count[BINDER_LAT_COUNT][BINDER_LAT_BUCKETS];
+	u64 total_ns[BINDER_LAT_COUNT];
+};
+
+static const char * const binder_lat_strings[] = {
+	"queue",
+	"dispatch",
+	"reply"
+};
+
+static void binder_lat_record(struct binder_lat_hist __percpu *hist,
+			      enum binder_lat_types type, u64 delta_ns)
+{
+	u64 us = div_u64(delta_ns, NSEC_PER_USEC);
+	int bucket = us ? min_t(int, ilog2(us), BINDER_LAT_BUCKETS - 1) : 0;
+
+	if (!hist)
+		return;
+	this_cpu_inc(hist->count[type][bucket]);
+	this_cpu_add(hist->total_ns[type], delta_ns);
+}
+#endif
+
 /**
  * struct binder_work - work enqueued on a worklist
  * @entry:             node enqueued on list
@@ -334,6 +373,9 @@ struct binder_error {
  *                        (invariant after initialized)
  * @async_todo:           list of async work items
  *                        (protected by @proc->inner_lock)
+ * @lat_hist:             per-CPU latency histograms, allocated on the
+ *                        first delivered transaction
+ *                        (set once with cmpxchg, no lock needed)
  *
  * Bookkeeping structure for binder nodes.
  */
@@ -375,6 +417,9 @@ struct binder_node {
 	};
 	bool has_async_transaction;
 	struct list_head async_todo;
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	struct binder_lat_hist __percpu *lat_hist;
+#endif
 };
 
 struct binder_ref_death {
@@ -531,6 +576,9 @@ struct binder_priority {
  * @binderfs_entry:       process-specific binderfs log file
  * @oneway_spam_detection_enabled: process enabled oneway spam detection
  *                        or not
+ * @lat_hist:             per-CPU latency histograms of transactions
+ *                        received by this proc
+ *                        (invariant after initialized, may be NULL)
  *
  * Bookkeeping structure for binder processes
  */
@@ -572,6 +620,9 @@ struct binder_proc {
 	spinlock_t outer_lock;
 	struct dentry *binderfs_entry;
 	bool oneway_spam_detection_enabled;
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	struct binder_lat_hist __percpu *lat_hist;
+#endif
 };
 
 enum {
@@ -660,6 +711,10 @@ struct binder_transaction {
 	bool    set_priority_called;
 	kuid_t	sender_euid;
 	binder_uintptr_t security_ctx;
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	u64	start_ns;
+	u64	queued_ns;
+#endif
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
 	 *
@@ -689,6 +744,87 @@ struct binder_object {
 	};
 };
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+static struct binder_lat_hist __percpu *binder_node_lat_hist(
+		struct binder_node *node)
+{
+	struct binder_lat_hist __percpu *hist = READ_ONCE(node->lat_hist);
+
+	if (hist)
+		return hist;
+
+	hist = alloc_percpu_gfp(struct binder_lat_hist,
+				GFP_KERNEL | __GFP_NOWARN);
+	if (!hist)
+		return NULL;
+	if (cmpxchg(&node->lat_hist, NULL, hist)) {
+		free_percpu(hist);
+		hist = READ_ONCE(node->lat_hist);
+	}
+	return hist;
+}
+
+static inline void binder_lat_txn_start(struct binder_transaction *t)
+{
+	t->start_ns = ktime_get_ns();
+}
+
+static inline void binder_lat_txn_queued(struct binder_transaction *t)
+{
+	t->queued_ns = ktime_get_ns();
+}
+
+/*
+ * Called by the receiving thread when @t is handed out as BR_TRANSACTION.
+ * The buffer holds a strong ref on @node so it cannot go away here.
+ */
+static void binder_lat_txn_received(struct binder_proc *proc,
+				    struct binder_node *node,
+				    struct binder_transaction *t)
+{
+	struct binder_lat_hist __percpu *node_hist = binder_node_lat_hist(node);
+	u64 now = ktime_get_ns();
+
+	binder_lat_record(proc->lat_hist, BINDER_LAT_QUEUE, now - t->queued_ns);
+	binder_lat_record(node_hist, BINDER_LAT_QUEUE, now - t->queued_ns);
+	binder_lat_record(proc->lat_hist, BINDER_LAT_DISPATCH,
+			  now - t->start_ns);
+	binder_lat_record(node_hist, BINDER_LAT_DISPATCH, now - t->start_ns);
+}
+
+/*
+ * Called with @proc->inner_lock held when @proc replies to @t. The
+ * buffer (and the node ref it holds) can only be released under that
+ * lock, so the node is stable while the buffer is still attached.
+ */
+static void binder_lat_txn_reply_ilocked(struct binder_proc *proc,
+					 struct binder_transaction *t)
+{
+	u64 delta_ns = ktime_get_ns() - t->start_ns;
+
+	binder_lat_record(proc->lat_hist, BINDER_LAT_REPLY, delta_ns);
+	if (t->buffer && t->buffer->target_node)
+		binder_lat_record(READ_ONCE(t->buffer->target_node->lat_hist),
+				  BINDER_LAT_REPLY, delta_ns);
+}
+#else
+static inline void binder_lat_txn_start(struct binder_transaction *t)
+{
+}
+static inline void binder_lat_txn_queued(struct binder_transaction *t)
+{
+}
+static inline void binder_lat_txn_received(struct binder_proc *proc,
+					   struct binder_node *node,
+					   struct binder_transaction *t)
+{
+}
+static inline void binder_lat_txn_reply_ilocked(struct binder_proc *proc,
+						struct binder_transaction *t)
+{
+}
+#endif
+
 /**
  * binder_proc_lock() - Acquire outer lock for given binder_proc
  * @proc:         struct binder_proc to acquire
@@ -1402,6 +1538,9 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 
 static void binder_free_node(struct binder_node *node)
 {
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	free_percpu(node->lat_hist);
+#endif
 	kfree(node);
 	binder_stats_deleted(BINDER_STAT_NODE);
 }
@@ -2943,6 +3082,7 @@ static int binder_proc_transaction(struct binder_transaction *t,
 	if (!thread && !pending_async)
 		thread = binder_select_thread_ilocked(proc);
 
+	binder_lat_txn_queued(t);
 	if (thread) {
 		binder_transaction_priority(thread->task, t, node_prio,
 					    node->inherit_rt);
@@ -3075,6 +3215,7 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_bad_call_stack;
 		}
 		thread->transaction_stack = in_reply_to->to_parent;
+		binder_lat_txn_reply_ilocked(proc, in_reply_to);
 		binder_inner_proc_unlock(proc);
 		target_thread = binder_get_txn_from_and_acq_inner(in_reply_to);
 		if (target_thread == NULL) {
@@ -3212,6 +3353,7 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	binder_stats_created(BINDER_STAT_TRANSACTION);
 	spin_lock_init(&t->lock);
+	binder_lat_txn_start(t);
 
 	tcomplete = kzalloc(sizeof(*tcomplete), GFP_KERNEL);
 	if (tcomplete == NULL) {
@@ -4513,6 +4655,7 @@ static int binder_thread_read(struct binder_proc *proc,
 			node_prio.prio = target_node->min_priority;
 			binder_transaction_priority(current, t, node_prio,
 						    target_node->inherit_rt);
+			binder_lat_txn_received(proc, target_node, t);
 			cmd = BR_TRANSACTION;
 		} else {
 			trd->target.ptr = 0;
@@ -4754,6 +4897,9 @@ static void binder_free_proc(struct binder_proc *proc)
 	binder_alloc_deferred_release(&proc->alloc);
 	put_task_struct(proc->tsk);
 	put_cred(proc->cred);
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	free_percpu(proc->lat_hist);
+#endif
 	binder_stats_deleted(BINDER_STAT_PROC);
 	kfree(proc);
 }
@@ -5493,6 +5639,11 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	refcount_inc(&binder_dev->ref);
 	proc->context = &binder_dev->context;
 	binder_alloc_init(&proc->alloc);
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+	/* Stats are best effort, run without them if this fails */
+	proc->lat_hist = alloc_percpu_gfp(struct binder_lat_hist,
+					  GFP_KERNEL | __GFP_NOWARN);
+#endif
 
 	binder_stats_created(BINDER_STAT_PROC);
 	proc->pid = current->group_leader->pid;
@@ -6344,6 +6495,77 @@ int binder_transaction_log_show(struct seq_file *m, void *unused)
 }
 #endif
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+static void print_binder_lat_hist(struct seq_file *m, const char *prefix,
+				  struct binder_lat_hist __percpu *hist)
+{
+	struct binder_lat_hist sum;
+	int cpu, i, j;
+
+	if (!hist)
+		return;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct binder_lat_hist *h = per_cpu_ptr(hist, cpu);
+
+		for (i = 0; i < BINDER_LAT_COUNT; i++) {
+			for (j = 0; j < BINDER_LAT_BUCKETS; j++)
+				sum.count[i][j] += h->count[i][j];
+			sum.total_ns[i] += h->total_ns[i];
+		}
+	}
+
+	BUILD_BUG_ON(ARRAY_SIZE(binder_lat_strings) != BINDER_LAT_COUNT);
+	for (i = 0; i < BINDER_LAT_COUNT; i++) {
+		u64 count = 0;
+
+		for (j = 0; j < BINDER_LAT_BUCKETS; j++)
+			count += sum.count[i][j];
+		if (!count)
+			continue;
+		seq_printf(m, "%s%s: count %llu avg %lluus:", prefix,
+			   binder_lat_strings[i], count,
+			   div64_u64(sum.total_ns[i], count) / NSEC_PER_USEC);
+		for (j = 0; j < BINDER_LAT_BUCKETS; j++)
+			seq_printf(m, " %llu", sum.count[i][j]);
+		seq_puts(m, "\n");
+	}
+}
+
+int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct binder_node *node;
+	struct rb_node *n;
+	int i;
+
+	seq_puts(m, "binder latency buckets (us):");
+	for (i = 0; i < BINDER_LAT_BUCKETS - 1; i++)
+		seq_printf(m, " <%u", 2U << i);
+	seq_printf(m, " >=%u\n", 1U << (BINDER_LAT_BUCKETS - 1));
+
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, &binder_procs, proc_node) {
+		seq_printf(m, "proc %d\n", proc->pid);
+		print_binder_lat_hist(m, "  ", proc->lat_hist);
+		binder_inner_proc_lock(proc);
+		for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n)) {
+			node = rb_entry(n, struct binder_node, rb_node);
+			if (!READ_ONCE(node->lat_hist))
+				continue;
+			seq_printf(m, "  node %d\n", node->debug_id);
+			print_binder_lat_hist(m, "    ",
+					      READ_ONCE(node->lat_hist));
+		}
+		binder_inner_proc_unlock(proc);
+	}
+	mutex_unlock(&binder_procs_lock);
+
+	return 0;
+}
+#endif
+
 const struct file_operations binder_fops = {
 	.owner = THIS_MODULE,
 	.poll = binder_poll,
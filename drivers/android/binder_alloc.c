@@ -37,6 +37,11 @@ struct list_lru binder_alloc_lru;
 
 static DEFINE_MUTEX(binder_alloc_mmap_lock);
 
+/* allocs that may hold reserve pages, walked by the shrinker */
+static LIST_HEAD(binder_alloc_reserve_allocs);
+static DEFINE_SPINLOCK(binder_alloc_reserve_lock);
+static atomic_long_t binder_alloc_reserve_total;
+
 enum {
 	BINDER_DEBUG_USER_ERROR             = 1U << 0,
 	BINDER_DEBUG_OPEN_CLOSE             = 1U << 1,
@@ -48,6 +53,11 @@ static uint32_t binder_alloc_debug_mask;
 module_param_named(debug_mask, binder_alloc_debug_mask,
 		   uint, 0644);
 
+static unsigned int binder_alloc_reserve_pages = 8;
+
+module_param_named(reserve_pages, binder_alloc_reserve_pages,
+		   uint, 0644);
+
 #define binder_alloc_debug(mask, x...) \
 	do { \
 		if (binder_alloc_debug_mask & mask) \
@@ -72,6 +82,11 @@ static size_t binder_alloc_buffer_size(struct binder_alloc *alloc,
 	return binder_buffer_next(buffer)->user_data - buffer->user_data;
 }
 
+static inline int binder_alloc_bin(size_t size)
+{
+	return (size - 1) >> BINDER_ALLOC_BIN_SHIFT;
+}
+
 static void binder_insert_free_buffer(struct binder_alloc *alloc,
 				      struct binder_buffer *new_buffer)
 {
@@ -89,6 +104,14 @@ static void binder_insert_free_buffer(struct binder_alloc *alloc,
 		     "%d: add free buffer, size %zd, at %pK\n",
 		      alloc->pid, new_buffer_size, new_buffer);
 
+	if (new_buffer_size <= BINDER_ALLOC_BIN_MAX) {
+		int bin = binder_alloc_bin(new_buffer_size);
+
+		list_add(&new_buffer->bin_entry, &alloc->free_bins[bin]);
+		__set_bit(bin, &alloc->free_bins_map);
+		return;
+	}
+
 	while (*p) {
 		parent = *p;
 		buffer = rb_entry(parent, struct binder_buffer, rb_node);
@@ -105,6 +128,29 @@ static void binder_insert_free_buffer(struct binder_alloc *alloc,
 	rb_insert_color(&new_buffer->rb_node, &alloc->free_buffers);
 }
 
+/*
+ * Must be called before @buffer's neighbours in alloc->buffers change,
+ * since the size class is derived from the address of the next buffer.
+ */
+static void binder_erase_free_buffer(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_alloc_buffer_size(alloc, buffer);
+	int bin;
+
+	BUG_ON(!buffer->free);
+
+	if (buffer_size > BINDER_ALLOC_BIN_MAX) {
+		rb_erase(&buffer->rb_node, &alloc->free_buffers);
+		return;
+	}
+
+	bin = binder_alloc_bin(buffer_size);
+	list_del(&buffer->bin_entry);
+	if (list_empty(&alloc->free_bins[bin]))
+		__clear_bit(bin, &alloc->free_bins_map);
+}
+
 static void binder_insert_allocated_buffer_locked(
 		struct binder_alloc *alloc, struct binder_buffer *new_buffer)
 {
@@ -185,6 +231,69 @@ struct binder_buffer *binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 	return buffer;
 }
 
+static struct page *binder_alloc_zeroed_page(gfp_t gfp)
+{
+	return alloc_page(gfp | __GFP_HIGHMEM | __GFP_ZERO);
+}
+
+/*
+ * Move zeroed pages from @pages onto the reserve while it holds fewer than
+ * @limit pages and free the rest. Must be called with @alloc->mutex held.
+ */
+static void binder_alloc_put_pages(struct binder_alloc *alloc,
+				   struct list_head *pages,
+				   unsigned int limit)
+{
+	struct page *page, *tmp;
+
+	list_for_each_entry_safe(page, tmp, pages, lru) {
+		if (alloc->reserve_count < limit) {
+			list_move(&page->lru, &alloc->reserve);
+			alloc->reserve_count++;
+			atomic_long_inc(&binder_alloc_reserve_total);
+		} else {
+			list_del(&page->lru);
+			__free_page(page);
+		}
+	}
+}
+
+/**
+ * binder_alloc_get_pages() - get zeroed pages for a buffer range
+ * @alloc:	binder_alloc for this proc
+ * @pages:	list to add the pages to, linked through page->lru
+ * @nr_pages:	number of pages needed
+ *
+ * Pages come from the pre-zeroed reserve first and from the page
+ * allocator for the rest. Must be called with @alloc->mutex held.
+ *
+ * Return:	0 on success, -ENOMEM if not all pages could be allocated,
+ *		in which case @pages is left empty
+ */
+static int binder_alloc_get_pages(struct binder_alloc *alloc,
+				  struct list_head *pages, size_t nr_pages)
+{
+	size_t nr_reserve = min_t(size_t, nr_pages, alloc->reserve_count);
+	struct page *page;
+	size_t i;
+
+	for (i = 0; i < nr_reserve; i++)
+		list_move(alloc->reserve.next, pages);
+	alloc->reserve_count -= nr_reserve;
+	atomic_long_sub(nr_reserve, &binder_alloc_reserve_total);
+
+	for (; i < nr_pages; i++) {
+		page = binder_alloc_zeroed_page(GFP_KERNEL);
+		if (!page) {
+			binder_alloc_put_pages(alloc, pages,
+					       binder_alloc_reserve_pages);
+			return -ENOMEM;
+		}
+		list_add(&page->lru, pages);
+	}
+	return 0;
+}
+
 static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 				    void __user *start, void __user *end)
 {
@@ -193,7 +302,8 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 	struct binder_lru_page *page;
 	struct vm_area_struct *vma = NULL;
 	struct mm_struct *mm = NULL;
-	bool need_mm = false;
+	LIST_HEAD(new_pages);
+	size_t nr_new = 0;
 
 	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "%d: %s pages %pK-%pK\n", alloc->pid,
@@ -209,13 +319,21 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
 		page = &alloc->pages[(page_addr - alloc->buffer) / PAGE_SIZE];
-		if (!page->page_ptr) {
-			need_mm = true;
-			break;
-		}
+		if (!page->page_ptr)
+			nr_new++;
+	}
+
+	/*
+	 * Get every missing page up front, before mmap_sem is taken, so
+	 * the mapping loop below only has to insert them.
+	 */
+	if (nr_new && binder_alloc_get_pages(alloc, &new_pages, nr_new)) {
+		pr_err("%d: binder_alloc_buf failed to allocate %zu pages\n",
+		       alloc->pid, nr_new);
+		return -ENOMEM;
 	}
 
-	if (need_mm && mmget_not_zero(alloc->vma_vm_mm))
+	if (nr_new && mmget_not_zero(alloc->vma_vm_mm))
 		mm = alloc->vma_vm_mm;
 
 	if (mm) {
@@ -223,7 +341,7 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		vma = alloc->vma;
 	}
 
-	if (!vma && need_mm) {
+	if (!vma && nr_new) {
 		pr_err("%d: binder_alloc_buf failed to map pages in userspace, no vma\n",
 			alloc->pid);
 		goto err_no_vma;
@@ -251,14 +369,10 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 			goto err_page_ptr_cleared;
 
 		trace_binder_alloc_page_start(alloc, index);
-		page->page_ptr = alloc_page(GFP_KERNEL |
-					    __GFP_HIGHMEM |
-					    __GFP_ZERO);
-		if (!page->page_ptr) {
-			pr_err("%d: binder_alloc_buf failed for page at %pK\n",
-				alloc->pid, page_addr);
+		if (WARN_ON(list_empty(&new_pages)))
 			goto err_alloc_page_failed;
-		}
+		page->page_ptr = list_first_entry(&new_pages, struct page, lru);
+		list_del(&page->page_ptr->lru);
 		page->alloc = alloc;
 		INIT_LIST_HEAD(&page->lru);
 
@@ -313,6 +427,7 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		up_read(&mm->mmap_sem);
 		mmput(mm);
 	}
+	binder_alloc_put_pages(alloc, &new_pages, binder_alloc_reserve_pages);
 	return vma ? -ENOMEM : -ESRCH;
 }
 
@@ -387,6 +502,85 @@ static bool debug_low_async_space_locked(struct binder_alloc *alloc, int pid)
 	return false;
 }
 
+/*
+ * Best fit among the small free buffers. Within the first candidate bin
+ * sizes differ, so that list is scanned; every buffer in a higher bin is
+ * large enough and the most recently freed one is taken.
+ */
+static struct binder_buffer *binder_alloc_bin_fit(struct binder_alloc *alloc,
+						  size_t size,
+						  size_t *buffer_sizep)
+{
+	struct binder_buffer *buffer, *best_fit = NULL;
+	size_t buffer_size, best_fit_size = 0;
+	int bin;
+
+	if (size > BINDER_ALLOC_BIN_MAX)
+		return NULL;
+
+	bin = binder_alloc_bin(size);
+	if (test_bit(bin, &alloc->free_bins_map)) {
+		list_for_each_entry(buffer, &alloc->free_bins[bin], bin_entry) {
+			BUG_ON(!buffer->free);
+			buffer_size = binder_alloc_buffer_size(alloc, buffer);
+			if (buffer_size < size)
+				continue;
+			if (!best_fit || buffer_size < best_fit_size) {
+				best_fit = buffer;
+				best_fit_size = buffer_size;
+				if (buffer_size == size)
+					break;
+			}
+		}
+		if (best_fit) {
+			*buffer_sizep = best_fit_size;
+			return best_fit;
+		}
+	}
+
+	bin = find_next_bit(&alloc->free_bins_map, BINDER_ALLOC_BINS, bin + 1);
+	if (bin >= BINDER_ALLOC_BINS)
+		return NULL;
+
+	buffer = list_first_entry(&alloc->free_bins[bin], struct binder_buffer,
+				  bin_entry);
+	BUG_ON(!buffer->free);
+	*buffer_sizep = binder_alloc_buffer_size(alloc, buffer);
+	return buffer;
+}
+
+static struct binder_buffer *binder_alloc_tree_fit(struct binder_alloc *alloc,
+						   size_t size,
+						   size_t *buffer_sizep)
+{
+	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *best_fit = NULL;
+	struct binder_buffer *buffer;
+	size_t buffer_size;
+
+	while (n) {
+		buffer = rb_entry(n, struct binder_buffer, rb_node);
+		BUG_ON(!buffer->free);
+		buffer_size = binder_alloc_buffer_size(alloc, buffer);
+
+		if (size < buffer_size) {
+			best_fit = n;
+			n = n->rb_left;
+		} else if (size > buffer_size)
+			n = n->rb_right;
+		else {
+			best_fit = n;
+			break;
+		}
+	}
+	if (best_fit == NULL)
+		return NULL;
+
+	buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
+	*buffer_sizep = binder_alloc_buffer_size(alloc, buffer);
+	return buffer;
+}
+
 static struct binder_buffer *binder_alloc_new_buf_locked(
 				struct binder_alloc *alloc,
 				size_t data_size,
@@ -395,10 +589,10 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				int is_async,
 				int pid)
 {
-	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
+	struct binder_buffer *new_buffer = NULL;
 	size_t buffer_size;
-	struct rb_node *best_fit = NULL;
 	void __user *has_page_addr;
 	void __user *end_page_addr;
 	size_t size, data_offsets_size;
@@ -437,28 +631,17 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
-	while (n) {
-		buffer = rb_entry(n, struct binder_buffer, rb_node);
-		BUG_ON(!buffer->free);
-		buffer_size = binder_alloc_buffer_size(alloc, buffer);
-
-		if (size < buffer_size) {
-			best_fit = n;
-			n = n->rb_left;
-		} else if (size > buffer_size)
-			n = n->rb_right;
-		else {
-			best_fit = n;
-			break;
-		}
-	}
-	if (best_fit == NULL) {
+	buffer = binder_alloc_bin_fit(alloc, size, &buffer_size);
+	if (!buffer)
+		buffer = binder_alloc_tree_fit(alloc, size, &buffer_size);
+	if (!buffer) {
 		size_t allocated_buffers = 0;
 		size_t largest_alloc_size = 0;
 		size_t total_alloc_size = 0;
 		size_t free_buffers = 0;
 		size_t largest_free_size = 0;
 		size_t total_free_size = 0;
+		int i;
 
 		for (n = rb_first(&alloc->allocated_buffers); n != NULL;
 		     n = rb_next(n)) {
@@ -478,6 +661,17 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			if (buffer_size > largest_free_size)
 				largest_free_size = buffer_size;
 		}
+		for (i = 0; i < BINDER_ALLOC_BINS; i++) {
+			list_for_each_entry(buffer, &alloc->free_bins[i],
+					    bin_entry) {
+				buffer_size = binder_alloc_buffer_size(alloc,
+								       buffer);
+				free_buffers++;
+				total_free_size += buffer_size;
+				if (buffer_size > largest_free_size)
+					largest_free_size = buffer_size;
+			}
+		}
 		pr_err("%d: binder_alloc_buf size %zd failed, no address space\n",
 			alloc->pid, size);
 		pr_err("allocated: %zd (num: %zd largest: %zd), free: %zd (num: %zd largest: %zd)\n",
@@ -485,10 +679,6 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		       total_free_size, free_buffers, largest_free_size);
 		return ERR_PTR(-ENOSPC);
 	}
-	if (n == NULL) {
-		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
-		buffer_size = binder_alloc_buffer_size(alloc, buffer);
-	}
 
 	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "%d: binder_alloc_buf size %zd got buffer %pK size %zd\n",
@@ -496,7 +686,6 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 
 	has_page_addr = (void __user *)
 		(((uintptr_t)buffer->user_data + buffer_size) & PAGE_MASK);
-	WARN_ON(n && buffer_size != size);
 	end_page_addr =
 		(void __user *)PAGE_ALIGN((uintptr_t)buffer->user_data + size);
 	if (end_page_addr > has_page_addr)
@@ -507,21 +696,22 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		return ERR_PTR(ret);
 
 	if (buffer_size != size) {
-		struct binder_buffer *new_buffer;
-
 		new_buffer = kzalloc(sizeof(*buffer), GFP_KERNEL);
 		if (!new_buffer) {
 			pr_err("%s: %d failed to alloc new buffer struct\n",
 			       __func__, alloc->pid);
 			goto err_alloc_buf_struct_failed;
 		}
+	}
+
+	binder_erase_free_buffer(alloc, buffer);
+	if (new_buffer) {
 		new_buffer->user_data = (u8 __user *)buffer->user_data + size;
 		list_add(&new_buffer->entry, &buffer->entry);
 		new_buffer->free = 1;
 		binder_insert_free_buffer(alloc, new_buffer);
 	}
 
-	rb_erase(best_fit, &alloc->free_buffers);
 	buffer->free = 0;
 	buffer->allow_user_free = 0;
 	binder_insert_allocated_buffer_locked(alloc, buffer);
@@ -690,7 +880,7 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 		struct binder_buffer *next = binder_buffer_next(buffer);
 
 		if (next->free) {
-			rb_erase(&next->rb_node, &alloc->free_buffers);
+			binder_erase_free_buffer(alloc, next);
 			binder_delete_free_buffer(alloc, next);
 		}
 	}
@@ -698,14 +888,49 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 		struct binder_buffer *prev = binder_buffer_prev(buffer);
 
 		if (prev->free) {
+			binder_erase_free_buffer(alloc, prev);
 			binder_delete_free_buffer(alloc, buffer);
-			rb_erase(&prev->rb_node, &alloc->free_buffers);
 			buffer = prev;
 		}
 	}
 	binder_insert_free_buffer(alloc, buffer);
 }
 
+/**
+ * binder_alloc_reserve_refill() - top up the pre-zeroed page reserve
+ * @alloc:	binder_alloc for this proc
+ *
+ * Called after a buffer is freed so that allocating and zeroing pages
+ * happens off the transaction path. The reserve is only refilled once it
+ * is below half of reserve_pages, and never by entering direct reclaim.
+ */
+static void binder_alloc_reserve_refill(struct binder_alloc *alloc)
+{
+	unsigned int want = READ_ONCE(binder_alloc_reserve_pages);
+	unsigned int have = READ_ONCE(alloc->reserve_count);
+	LIST_HEAD(pages);
+	struct page *page;
+
+	if (have >= DIV_ROUND_UP(want, 2) || !binder_alloc_get_vma(alloc))
+		return;
+
+	for (; have < want; have++) {
+		page = binder_alloc_zeroed_page(GFP_KERNEL | __GFP_NORETRY |
+						__GFP_NOWARN);
+		if (!page)
+			break;
+		list_add(&page->lru, &pages);
+	}
+	if (list_empty(&pages))
+		return;
+
+	mutex_lock(&alloc->mutex);
+	/* Don't keep pages for a proc whose vma is already gone */
+	binder_alloc_put_pages(alloc, &pages,
+			       binder_alloc_get_vma(alloc) ? want : 0);
+	mutex_unlock(&alloc->mutex);
+}
+
 static void binder_alloc_clear_buf(struct binder_alloc *alloc,
 				   struct binder_buffer *buffer);
 /**
@@ -733,6 +958,7 @@ void binder_alloc_free_buf(struct binder_alloc *alloc,
 	mutex_lock(&alloc->mutex);
 	binder_free_buf_locked(alloc, buffer);
 	mutex_unlock(&alloc->mutex);
+	binder_alloc_reserve_refill(alloc);
 }
 
 /**
@@ -790,6 +1016,10 @@ int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 	binder_alloc_set_vma(alloc, vma);
 	mmgrab(alloc->vma_vm_mm);
 
+	spin_lock(&binder_alloc_reserve_lock);
+	list_add_tail(&alloc->reserve_node, &binder_alloc_reserve_allocs);
+	spin_unlock(&binder_alloc_reserve_lock);
+
 	return 0;
 
 err_alloc_buf_struct_failed:
@@ -812,6 +1042,10 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 	int buffers, page_count;
 	struct binder_buffer *buffer;
 
+	spin_lock(&binder_alloc_reserve_lock);
+	list_del_init(&alloc->reserve_node);
+	spin_unlock(&binder_alloc_reserve_lock);
+
 	buffers = 0;
 	mutex_lock(&alloc->mutex);
 	BUG_ON(alloc->vma);
@@ -863,6 +1097,16 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 		}
 		kfree(alloc->pages);
 	}
+	atomic_long_sub(alloc->reserve_count, &binder_alloc_reserve_total);
+	page_count += alloc->reserve_count;
+	alloc->reserve_count = 0;
+	while (!list_empty(&alloc->reserve)) {
+		struct page *page = list_first_entry(&alloc->reserve,
+						     struct page, lru);
+
+		list_del(&page->lru);
+		__free_page(page);
+	}
 	mutex_unlock(&alloc->mutex);
 	if (alloc->vma_vm_mm)
 		mmdrop(alloc->vma_vm_mm);
@@ -929,6 +1173,8 @@ void binder_alloc_print_pages(struct seq_file *m,
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
+	seq_printf(m, "  pages reserved: %u\n",
+		   READ_ONCE(alloc->reserve_count));
 }
 
 /**
@@ -1036,10 +1282,49 @@ enum lru_status binder_alloc_free_page(struct list_head *item,
 	return LRU_SKIP;
 }
 
+/*
+ * Free up to @nr_to_scan reserve pages. Only used for the part of a scan
+ * that the lru could not satisfy, since lru pages are colder.
+ */
+static unsigned long binder_alloc_reserve_drain(unsigned long nr_to_scan)
+{
+	struct binder_alloc *alloc;
+	unsigned long freed = 0;
+	unsigned int nr;
+	LIST_HEAD(pages);
+
+	spin_lock(&binder_alloc_reserve_lock);
+	list_for_each_entry(alloc, &binder_alloc_reserve_allocs, reserve_node) {
+		if (freed >= nr_to_scan)
+			break;
+		if (!READ_ONCE(alloc->reserve_count) ||
+		    !mutex_trylock(&alloc->mutex))
+			continue;
+		nr = min_t(unsigned long, alloc->reserve_count,
+			   nr_to_scan - freed);
+		freed += nr;
+		alloc->reserve_count -= nr;
+		while (nr--)
+			list_move(alloc->reserve.next, &pages);
+		mutex_unlock(&alloc->mutex);
+	}
+	spin_unlock(&binder_alloc_reserve_lock);
+
+	atomic_long_sub(freed, &binder_alloc_reserve_total);
+	while (!list_empty(&pages)) {
+		struct page *page = list_first_entry(&pages, struct page, lru);
+
+		list_del(&page->lru);
+		__free_page(page);
+	}
+	return freed;
+}
+
 static unsigned long
 binder_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 {
-	unsigned long ret = list_lru_count(&binder_alloc_lru);
+	unsigned long ret = list_lru_count(&binder_alloc_lru) +
+		atomic_long_read(&binder_alloc_reserve_total);
 	return ret;
 }
 
@@ -1050,6 +1335,8 @@ binder_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 
 	ret = list_lru_walk(&binder_alloc_lru, binder_alloc_free_page,
 			    NULL, sc->nr_to_scan);
+	if (ret < sc->nr_to_scan)
+		ret += binder_alloc_reserve_drain(sc->nr_to_scan - ret);
 	return ret;
 }
 
@@ -1068,9 +1355,15 @@ static struct shrinker binder_shrinker = {
  */
 void binder_alloc_init(struct binder_alloc *alloc)
 {
+	int i;
+
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	for (i = 0; i < BINDER_ALLOC_BINS; i++)
+		INIT_LIST_HEAD(&alloc->free_bins[i]);
+	INIT_LIST_HEAD(&alloc->reserve);
+	INIT_LIST_HEAD(&alloc->reserve_node);
 }
 
 int binder_alloc_shrinker_init(void)
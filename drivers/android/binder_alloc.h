@@ -31,6 +31,7 @@ struct binder_transaction;
  * struct binder_buffer - buffer used for binder transactions
  * @entry:              entry alloc->buffers
  * @rb_node:            node for allocated_buffers/free_buffers rb trees
+ * @bin_entry:          entry in alloc->free_bins for small free buffers
  * @free:               %true if buffer is free
  * @clear_on_free:      %true if buffer must be zeroed after use
  * @allow_user_free:    %true if user is allowed to free buffer
@@ -50,8 +51,11 @@ struct binder_transaction;
  */
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by address */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated */
+					/* entry by address */
+		struct list_head bin_entry; /* small free entry by size class */
+	};
 	unsigned free:1;
 	unsigned clear_on_free:1;
 	unsigned allow_user_free:1;
@@ -69,6 +73,16 @@ struct binder_buffer {
 	int    pid;
 };
 
+/*
+ * Free buffers of up to BINDER_ALLOC_BIN_MAX bytes are kept on segregated
+ * size-class lists instead of the free_buffers rb tree. Bin i holds free
+ * buffers with sizes in (i << BINDER_ALLOC_BIN_SHIFT,
+ * (i + 1) << BINDER_ALLOC_BIN_SHIFT].
+ */
+#define BINDER_ALLOC_BIN_SHIFT	6
+#define BINDER_ALLOC_BINS	16
+#define BINDER_ALLOC_BIN_MAX	(BINDER_ALLOC_BINS << BINDER_ALLOC_BIN_SHIFT)
+
 /**
  * struct binder_lru_page - page object used for binder shrinker
  * @page_ptr: pointer to physical page in mmap'd space
@@ -90,8 +104,11 @@ struct binder_lru_page {
  * @vma_vm_mm:          copy of vma->vm_mm (invarient after mmap)
  * @buffer:             base of per-proc address space mapped via mmap
  * @buffers:            list of all buffers for this proc
- * @free_buffers:       rb tree of buffers available for allocation
- *                      sorted by size
+ * @free_buffers:       rb tree of buffers larger than BINDER_ALLOC_BIN_MAX
+ *                      available for allocation sorted by size
+ * @free_bins:          size-class lists of free buffers up to
+ *                      BINDER_ALLOC_BIN_MAX, most recently freed first
+ * @free_bins_map:      bitmap of non-empty @free_bins
  * @allocated_buffers:  rb tree of allocated buffers sorted by address
  * @free_async_space:   VA space available for async buffers. This is
  *                      initialized at mmap time to 1/2 the full VA space
@@ -101,6 +118,11 @@ struct binder_lru_page {
  * @pages_high:         high watermark of offset in @pages
  * @oneway_spam_detected: %true if oneway spam detection fired, clear that
  * flag once the async buffer has returned to a healthy state
+ * @reserve:            list of pre-zeroed pages used before alloc_page()
+ *                      when populating buffer pages
+ * @reserve_count:      number of pages on @reserve
+ * @reserve_node:       entry in the global list of allocs with a reserve,
+ *                      drained by the shrinker
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -114,6 +136,8 @@ struct binder_alloc {
 	void __user *buffer;
 	struct list_head buffers;
 	struct rb_root free_buffers;
+	struct list_head free_bins[BINDER_ALLOC_BINS];
+	unsigned long free_bins_map;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 	struct binder_lru_page *pages;
@@ -122,6 +146,9 @@ struct binder_alloc {
 	int pid;
 	size_t pages_high;
 	bool oneway_spam_detected;
+	struct list_head reserve;
+	unsigned int reserve_count;
+	struct list_head reserve_node;
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -280,6 +280,85 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
 	}
 }
 
+/**
+ * binder_selftest_alloc_bins() - Test reuse of small free buffers.
+ * @alloc: Pointer to alloc struct.
+ *
+ * Allocate one buffer per size class followed by a guard buffer, free
+ * every other one so they cannot coalesce and land on the size-class
+ * bins, then allocate the same sizes again. Each allocation must be an
+ * exact fit from its bin, i.e. reuse the address of the freed buffer.
+ * Finally free everything and check that the address space coalesced
+ * back into a single free buffer and all pages can be reclaimed.
+ */
+static void binder_selftest_alloc_bins(struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffers[BINDER_ALLOC_BINS + 1] = {NULL};
+	void __user *user_data[BINDER_ALLOC_BINS];
+	struct rb_node *n;
+	size_t size;
+	int i;
+
+	for (i = 0; i <= BINDER_ALLOC_BINS; i++) {
+		/* The last one is the guard buffer */
+		size = i < BINDER_ALLOC_BINS ?
+			(size_t)(i + 1) << BINDER_ALLOC_BIN_SHIFT :
+			BUFFER_MIN_SIZE;
+		buffers[i] = binder_alloc_new_buf(alloc, size, 0, 0, 0, 0);
+		if (IS_ERR(buffers[i])) {
+			pr_err("bins: alloc of size %zu failed\n", size);
+			buffers[i] = NULL;
+			binder_selftest_failures++;
+			goto free_all;
+		}
+		if (i < BINDER_ALLOC_BINS)
+			user_data[i] = buffers[i]->user_data;
+	}
+
+	for (i = 1; i < BINDER_ALLOC_BINS; i += 2) {
+		binder_alloc_free_buf(alloc, buffers[i]);
+		buffers[i] = NULL;
+	}
+	if (!alloc->free_bins_map) {
+		pr_err("bins: freed small buffers not binned\n");
+		binder_selftest_failures++;
+	}
+
+	for (i = BINDER_ALLOC_BINS - 1; i > 0; i -= 2) {
+		size = (size_t)(i + 1) << BINDER_ALLOC_BIN_SHIFT;
+		buffers[i] = binder_alloc_new_buf(alloc, size, 0, 0, 0, 0);
+		if (IS_ERR(buffers[i])) {
+			pr_err("bins: realloc of size %zu failed\n", size);
+			buffers[i] = NULL;
+			binder_selftest_failures++;
+			goto free_all;
+		}
+		if (buffers[i]->user_data != user_data[i] ||
+		    !check_buffer_pages_allocated(alloc, buffers[i], size)) {
+			pr_err("bins: size %zu not reused from bin %d\n",
+			       size, i);
+			binder_selftest_failures++;
+		}
+	}
+	if (alloc->free_bins_map) {
+		pr_err("bins: bins not empty after refill\n");
+		binder_selftest_failures++;
+	}
+
+free_all:
+	for (i = 0; i <= BINDER_ALLOC_BINS; i++) {
+		if (buffers[i])
+			binder_alloc_free_buf(alloc, buffers[i]);
+	}
+
+	n = rb_first(&alloc->free_buffers);
+	if (alloc->free_bins_map || !n || rb_next(n)) {
+		pr_err("bins: free space did not coalesce\n");
+		binder_selftest_failures++;
+	}
+	binder_selftest_free_page(alloc);
+}
+
 /**
  * binder_selftest_alloc() - Test alloc and free of buffer pages.
  * @alloc: Pointer to alloc struct.
@@ -300,6 +379,7 @@ void binder_selftest_alloc(struct binder_alloc *alloc)
 		goto done;
 	pr_info("STARTED\n");
 	binder_selftest_alloc_offset(alloc, end_offset, 0);
+	binder_selftest_alloc_bins(alloc);
 	binder_selftest_run = false;
 	if (binder_selftest_failures > 0)
 		pr_info("%d tests FAILED\n", binder_selftest_failures);
@@ -145,6 +145,11 @@ struct binder_transaction_log {
 };
 #endif
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+int binder_latency_show(struct seq_file *m, void *unused);
+DEFINE_SHOW_ATTRIBUTE(binder_latency);
+#endif
+
 #ifdef CONFIG_ANDROID_BINDER_LOGS
 extern struct binder_transaction_log binder_transaction_log;
 extern struct binder_transaction_log binder_transaction_log_failed;
@@ -660,6 +660,22 @@ static inline int init_binder_logs(struct super_block *sb)
 }
 #endif
 
+#ifdef CONFIG_ANDROID_BINDER_LATENCY_STATS
+static int init_binder_latency(struct super_block *sb)
+{
+	struct dentry *dentry;
+
+	dentry = binderfs_create_file(sb->s_root, "binder_latency",
+				      &binder_latency_fops, NULL);
+	return PTR_ERR_OR_ZERO(dentry);
+}
+#else
+static inline int init_binder_latency(struct super_block *sb)
+{
+	return 0;
+}
+#endif
+
 static int binderfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	int ret;
@@ -737,8 +753,12 @@ static int binderfs_fill_super(struct super_block *sb, void *data, int silent)
 			name++;
 	}
 
-	if (info->mount_opts.stats_mode == STATS_GLOBAL)
+	if (info->mount_opts.stats_mode == STATS_GLOBAL) {
+		ret = init_binder_latency(sb);
+		if (ret)
+			return ret;
 		return init_binder_logs(sb);
+	}
 
 	return 0;
 }
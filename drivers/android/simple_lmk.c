@@ -5,15 +5,26 @@
 
 #define pr_fmt(fmt) "simple_lmk: " fmt
 
+#include <linux/debugfs.h>
 #include <linux/freezer.h>
+#include <linux/hashtable.h>
 #include <linux/kthread.h>
 #include <linux/mm.h>
 #include <linux/moduleparam.h>
 #include <linux/oom.h>
+#include <linux/seq_file.h>
+#include <linux/sched/signal.h>
+#include <linux/simple_lmk.h>
+#include <linux/slab.h>
 #include <linux/sort.h>
+#include <linux/swap.h>
 #include <linux/vmpressure.h>
+#include <linux/workqueue.h>
 #include <uapi/linux/sched/types.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/simple_lmk.h>
+
 /* The minimum number of pages to free per reclaim */
 #define MIN_FREE_PAGES (CONFIG_ANDROID_SIMPLE_LMK_MINFREE * SZ_1M / PAGE_SIZE)
 
@@ -23,14 +34,50 @@
 /* Timeout in jiffies for each reclaim */
 #define RECLAIM_EXPIRES msecs_to_jiffies(CONFIG_ANDROID_SIMPLE_LMK_TIMEOUT_MSEC)
 
+/* Interval in jiffies between refreshes of the victim index */
+#define SAMPLE_INTERVAL msecs_to_jiffies(1000)
+
+/* One victim bucket per killable adj, indexed from the least important down */
+#define NR_BUCKETS (OOM_SCORE_ADJ_MAX + 1)
+
+/* Minimum interval in jiffies between free page samples for prediction */
+#define PREDICT_SAMPLE_INTERVAL msecs_to_jiffies(50)
+
+/* Values for needs_reclaim */
+enum {
+	RECLAIM_NONE,
+	RECLAIM_REACTIVE,
+	RECLAIM_PREDICTIVE
+};
+
 struct victim_info {
 	struct task_struct *tsk;
 	struct mm_struct *mm;
 	unsigned long size;
 };
 
+/*
+ * An entry in the victim index, keyed by the process' tgid. Entries are kept
+ * in per-adj buckets sorted in descending order of their last sampled size so
+ * that reclaim only has to visit as many processes as it is going to kill.
+ */
+struct victim_node {
+	struct hlist_node hnode;
+	struct list_head bnode;
+	struct pid *pid;
+	unsigned long size;
+	unsigned int gen;
+	short adj;
+};
+
 static struct victim_info victims[MAX_VICTIMS] __cacheline_aligned_in_smp;
-static struct task_struct *task_bucket[SHRT_MAX + 1] __cacheline_aligned;
+static struct list_head victim_buckets[NR_BUCKETS] __cacheline_aligned;
+static DECLARE_BITMAP(victim_bucket_map, NR_BUCKETS);
+static DEFINE_HASHTABLE(victim_hash, 10);
+static DEFINE_SPINLOCK(victim_index_lock);
+static unsigned int victim_gen;
+static int nr_indexed;
+static bool victim_index_active;
 static DECLARE_WAIT_QUEUE_HEAD(oom_waitq);
 static DECLARE_COMPLETION(reclaim_done);
 static __cacheline_aligned_in_smp DEFINE_RWLOCK(mm_free_lock);
@@ -38,6 +85,50 @@ static int nr_victims;
 static atomic_t needs_reclaim = ATOMIC_INIT(0);
 static atomic_t nr_killed = ATOMIC_INIT(0);
 
+/*
+ * Predictive reclaim. The vmpressure callback tracks how fast free memory is
+ * falling and how full swap (zram) is; when memory is projected to hit the
+ * high watermarks within predict_horizon_ms while swap has little room left to
+ * absorb it, a small batch is killed early instead of waiting for pressure to
+ * reach 100.
+ */
+static bool predict_enable;
+module_param_named(predict, predict_enable, bool, 0644);
+static unsigned int predict_horizon_ms = 1000;
+module_param(predict_horizon_ms, uint, 0644);
+static unsigned int predict_min_pressure = 60;
+module_param(predict_min_pressure, uint, 0644);
+static unsigned int predict_swap_pct = 80;
+module_param(predict_swap_pct, uint, 0644);
+static unsigned int predict_batch_mb = CONFIG_ANDROID_SIMPLE_LMK_MINFREE / 4;
+module_param(predict_batch_mb, uint, 0644);
+static unsigned int predict_cooldown_ms = 2000;
+module_param(predict_cooldown_ms, uint, 0644);
+
+static struct {
+	spinlock_t lock;
+	unsigned long last_sample;
+	unsigned long last_kill;
+	unsigned long free;
+	unsigned long wmark;
+	long rate;
+	unsigned long eta_ms;
+	unsigned int pressure;
+	unsigned int swap_pct;
+	unsigned long nr_samples;
+	unsigned long nr_predicted;
+	unsigned long nr_cooldown;
+} pm = {
+	.lock = __SPIN_LOCK_UNLOCKED(pm.lock),
+	.eta_ms = ULONG_MAX
+};
+
+/* Reclaim counters, only written by the reclaim thread */
+static unsigned long nr_reactive_runs;
+static unsigned long nr_predictive_runs;
+static unsigned long nr_reactive_kills;
+static unsigned long nr_predictive_kills;
+
 static int victim_cmp(const void *lhs_ptr, const void *rhs_ptr)
 {
 	const struct victim_info *lhs = (typeof(lhs))lhs_ptr;
@@ -65,58 +156,233 @@ static unsigned long get_total_mm_pages(struct mm_struct *mm)
 	return pages;
 }
 
-static unsigned long find_victims(int *vindex)
+static struct victim_node *victim_lookup(struct pid *pid)
 {
-	short i, min_adj = SHRT_MAX, max_adj = 0;
-	unsigned long pages_found = 0;
+	struct victim_node *node;
+
+	hash_for_each_possible(victim_hash, node, hnode, (unsigned long)pid) {
+		if (node->pid == pid)
+			return node;
+	}
+
+	return NULL;
+}
+
+static void victim_bucket_del(struct victim_node *node)
+{
+	int b = OOM_SCORE_ADJ_MAX - node->adj;
+
+	list_del(&node->bnode);
+	if (list_empty(&victim_buckets[b]))
+		__clear_bit(b, victim_bucket_map);
+}
+
+static void victim_bucket_add(struct victim_node *node)
+{
+	int b = OOM_SCORE_ADJ_MAX - node->adj;
+	struct victim_node *pos;
+
+	/* Keep the bucket sorted in descending order of size */
+	list_for_each_entry(pos, &victim_buckets[b], bnode) {
+		if (pos->size < node->size)
+			break;
+	}
+	list_add_tail(&node->bnode, &pos->bnode);
+	__set_bit(b, victim_bucket_map);
+}
+
+static void victim_node_free(struct victim_node *node)
+{
+	put_pid(node->pid);
+	kfree(node);
+}
+
+/*
+ * Insert, move or drop the index entry for a process. A new entry consumes
+ * *prealloc; an entry dropped because the process became unkillable is
+ * returned so the caller can free it outside of the index lock.
+ */
+static struct victim_node *victim_index_update(struct pid *pid, short adj,
+					       unsigned long size,
+					       struct victim_node **prealloc)
+{
+	struct victim_node *node;
+
+	lockdep_assert_held(&victim_index_lock);
+
+	node = victim_lookup(pid);
+	if (adj < 0) {
+		if (node) {
+			hash_del(&node->hnode);
+			victim_bucket_del(node);
+			nr_indexed--;
+		}
+		return node;
+	}
+
+	if (node) {
+		victim_bucket_del(node);
+	} else {
+		node = *prealloc;
+		if (!node)
+			return NULL;
+		*prealloc = NULL;
+		node->pid = get_pid(pid);
+		hash_add(victim_hash, &node->hnode, (unsigned long)pid);
+		nr_indexed++;
+	}
+
+	node->adj = adj;
+	node->size = size;
+	node->gen = victim_gen;
+	victim_bucket_add(node);
+	return NULL;
+}
+
+/*
+ * Called after a process' oom_score_adj is written, possibly from within an
+ * RCU read-side section. Changes made before Simple LMK is initialized are
+ * ignored; the first sampler pass indexes every process anyway, and nothing
+ * would prune entries until the sampler runs.
+ */
+void simple_lmk_adj_changed(struct task_struct *task)
+{
+	struct victim_node *prealloc = NULL, *old;
+	struct task_struct *p;
+	unsigned long size;
+	short adj;
+
+	if (!smp_load_acquire(&victim_index_active))
+		return;
+
+	if (task->flags & PF_KTHREAD)
+		return;
+
+	/* Exiting processes are left for the sampler to prune */
+	p = find_lock_task_mm(task);
+	if (!p)
+		return;
+	size = get_total_mm_pages(p->mm);
+	task_unlock(p);
+
+	/* A failed allocation is picked up by the next sampler pass */
+	adj = READ_ONCE(task->signal->oom_score_adj);
+	if (adj >= 0)
+		prealloc = kmalloc(sizeof(*prealloc),
+				   GFP_NOWAIT | __GFP_NOWARN);
+
+	spin_lock(&victim_index_lock);
+	old = victim_index_update(task_tgid(task), adj, size, &prealloc);
+	spin_unlock(&victim_index_lock);
+
+	if (old)
+		victim_node_free(old);
+	kfree(prealloc);
+}
+
+/*
+ * Periodically refresh the victim index off of the reclaim path. This picks up
+ * processes which never had their adj written, updates every entry's size, and
+ * prunes entries for processes that have exited or become unkillable.
+ */
+static void victim_sample_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(victim_sample_work, victim_sample_fn);
+
+static void victim_sample_fn(struct work_struct *work)
+{
+	struct victim_node *node, *prealloc = NULL;
+	struct hlist_node *tmp;
 	struct task_struct *tsk;
+	LIST_HEAD(stale);
+	int bkt;
+
+	spin_lock(&victim_index_lock);
+	victim_gen++;
+	spin_unlock(&victim_index_lock);
 
 	rcu_read_lock();
 	for_each_process(tsk) {
-		struct signal_struct *sig;
+		struct task_struct *p;
+		unsigned long size;
 		short adj;
 
-		/*
-		 * Search for suitable tasks with a positive adj (importance).
-		 * Since only tasks with a positive adj can be targeted, that
-		 * naturally excludes tasks which shouldn't be killed, like init
-		 * and kthreads. Although oom_score_adj can still be changed
-		 * while this code runs, it doesn't really matter; we just need
-		 * a snapshot of the task's adj.
-		 */
-		sig = tsk->signal;
-		adj = READ_ONCE(sig->oom_score_adj);
-		if (adj < 0 ||
-		    sig->flags & (SIGNAL_GROUP_EXIT | SIGNAL_GROUP_COREDUMP) ||
-		    (thread_group_empty(tsk) && tsk->flags & PF_EXITING))
+		if (tsk->flags & PF_KTHREAD)
 			continue;
 
-		/* Store the task in a linked-list bucket based on its adj */
-		tsk->simple_lmk_next = task_bucket[adj];
-		task_bucket[adj] = tsk;
+		adj = READ_ONCE(tsk->signal->oom_score_adj);
+		if (adj < 0)
+			continue;
 
-		/* Track the min and max adjs to speed up the loop below */
-		if (adj > max_adj)
-			max_adj = adj;
-		if (adj < min_adj)
-			min_adj = adj;
+		p = find_lock_task_mm(tsk);
+		if (!p)
+			continue;
+		size = get_total_mm_pages(p->mm);
+		task_unlock(p);
+
+		if (!prealloc)
+			prealloc = kmalloc(sizeof(*prealloc),
+					   GFP_NOWAIT | __GFP_NOWARN);
+
+		spin_lock(&victim_index_lock);
+		victim_index_update(task_tgid(tsk), adj, size, &prealloc);
+		spin_unlock(&victim_index_lock);
 	}
+	rcu_read_unlock();
+	kfree(prealloc);
+
+	/* Anything not seen during this pass is gone or no longer killable */
+	spin_lock(&victim_index_lock);
+	hash_for_each_safe(victim_hash, bkt, tmp, node, hnode) {
+		if (node->gen == victim_gen)
+			continue;
+		hash_del(&node->hnode);
+		victim_bucket_del(node);
+		nr_indexed--;
+		list_add(&node->bnode, &stale);
+	}
+	spin_unlock(&victim_index_lock);
+
+	while (!list_empty(&stale)) {
+		node = list_first_entry(&stale, typeof(*node), bnode);
+		list_del(&node->bnode);
+		victim_node_free(node);
+	}
+
+	queue_delayed_work(system_unbound_wq, &victim_sample_work,
+			   SAMPLE_INTERVAL);
+}
+
+static unsigned long find_victims(int *vindex, unsigned long target)
+{
+	unsigned long pages_found = 0;
+	struct victim_node *node;
+	int b;
+
+	rcu_read_lock();
+	spin_lock(&victim_index_lock);
 
 	/* Start searching for victims from the highest adj (least important) */
-	for (i = max_adj; i >= min_adj; i--) {
-		int old_vindex;
+	for_each_set_bit(b, victim_bucket_map, NR_BUCKETS) {
+		int old_vindex = *vindex;
 
-		tsk = task_bucket[i];
-		if (!tsk)
-			continue;
+		/*
+		 * Buckets are sorted by sampled size, so the walk can stop as
+		 * soon as enough pages are found. The sample may be stale, so
+		 * the real size is read below and used for the final ordering.
+		 */
+		list_for_each_entry(node, &victim_buckets[b], bnode) {
+			struct task_struct *tsk, *vtsk;
+			struct signal_struct *sig;
 
-		/* Clear out this bucket for the next time reclaim is done */
-		task_bucket[i] = NULL;
+			tsk = pid_task(node->pid, PIDTYPE_PID);
+			if (!tsk)
+				continue;
 
-		/* Iterate through every task with this adj */
-		old_vindex = *vindex;
-		do {
-			struct task_struct *vtsk;
+			sig = tsk->signal;
+			if (READ_ONCE(sig->oom_score_adj) < 0 ||
+			    sig->flags & (SIGNAL_GROUP_EXIT | SIGNAL_GROUP_COREDUMP) ||
+			    (thread_group_empty(tsk) && tsk->flags & PF_EXITING))
+				continue;
 
 			vtsk = find_lock_task_mm(tsk);
 			if (!vtsk)
@@ -130,10 +396,10 @@ static unsigned long find_victims(int *vindex)
 			/* Count the number of pages that have been found */
 			pages_found += victims[*vindex].size;
 
-			/* Make sure there's space left in the victim array */
-			if (++*vindex == MAX_VICTIMS)
+			/* Stop when out of space or enough pages are found */
+			if (++*vindex == MAX_VICTIMS || pages_found >= target)
 				break;
-		} while ((tsk = tsk->simple_lmk_next));
+		}
 
 		/* Go to the next bucket if nothing was found */
 		if (*vindex == old_vindex)
@@ -146,21 +412,17 @@ static unsigned long find_victims(int *vindex)
 		sort(&victims[old_vindex], *vindex - old_vindex,
 		     sizeof(*victims), victim_cmp, victim_swap);
 
-		/* Stop when we are out of space or have enough pages found */
-		if (*vindex == MAX_VICTIMS || pages_found >= MIN_FREE_PAGES) {
-			/* Zero out any remaining buckets we didn't touch */
-			if (i > min_adj)
-				memset(&task_bucket[min_adj], 0,
-				       (i - min_adj) * sizeof(*task_bucket));
+		if (*vindex == MAX_VICTIMS || pages_found >= target)
 			break;
-		}
 	}
+
+	spin_unlock(&victim_index_lock);
 	rcu_read_unlock();
 
 	return pages_found;
 }
 
-static int process_victims(int vlen)
+static int process_victims(int vlen, unsigned long target)
 {
 	unsigned long pages_found = 0;
 	int i, nr_to_kill = 0;
@@ -174,7 +436,7 @@ static int process_victims(int vlen)
 		struct task_struct *vtsk = victim->tsk;
 
 		/* The victim's mm lock is taken in find_victims; release it */
-		if (pages_found >= MIN_FREE_PAGES) {
+		if (pages_found >= target) {
 			task_unlock(vtsk);
 		} else {
 			pages_found += victim->size;
@@ -185,22 +447,25 @@ static int process_victims(int vlen)
 	return nr_to_kill;
 }
 
-static void scan_and_kill(void)
+static int scan_and_kill(unsigned long target)
 {
 	int i, nr_to_kill, nr_found = 0;
 	unsigned long pages_found;
+	u64 start = ktime_get_ns();
 
 	/* Populate the victims array with tasks sorted by adj and then size */
-	pages_found = find_victims(&nr_found);
+	pages_found = find_victims(&nr_found, target);
 	if (unlikely(!nr_found)) {
+		trace_simple_lmk_decision(READ_ONCE(nr_indexed), 0, 0, 0,
+					  ktime_get_ns() - start);
 		pr_err("No processes available to kill!\n");
-		return;
+		return 0;
 	}
 
 	/* Minimize the number of victims if we found more pages than needed */
-	if (pages_found > MIN_FREE_PAGES) {
+	if (pages_found > target) {
 		/* First round of processing to weed out unneeded victims */
-		nr_to_kill = process_victims(nr_found);
+		nr_to_kill = process_victims(nr_found, target);
 
 		/*
 		 * Try to kill as few of the chosen victims as possible by
@@ -212,12 +477,15 @@ static void scan_and_kill(void)
 		     victim_swap);
 
 		/* Second round of processing to finally select the victims */
-		nr_to_kill = process_victims(nr_to_kill);
+		nr_to_kill = process_victims(nr_to_kill, target);
 	} else {
 		/* Too few pages found, so all the victims need to be killed */
 		nr_to_kill = nr_found;
 	}
 
+	trace_simple_lmk_decision(READ_ONCE(nr_indexed), nr_found, nr_to_kill,
+				  pages_found, ktime_get_ns() - start);
+
 	/* Store the final number of victims for simple_lmk_mm_freed() */
 	write_lock(&mm_free_lock);
 	nr_victims = nr_to_kill;
@@ -228,10 +496,11 @@ static void scan_and_kill(void)
 		static const struct sched_param sched_zero_prio;
 		struct victim_info *victim = &victims[i];
 		struct task_struct *t, *vtsk = victim->tsk;
+		short adj = READ_ONCE(vtsk->signal->oom_score_adj);
 
 		pr_info("Killing %s with adj %d to free %lu KiB\n", vtsk->comm,
-			vtsk->signal->oom_score_adj,
-			victim->size << (PAGE_SHIFT - 10));
+			adj, victim->size << (PAGE_SHIFT - 10));
+		trace_simple_lmk_kill(vtsk, adj, victim->size);
 
 		/* Accelerate the victim's death by forcing the kill signal */
 		do_send_sig_info(SIGKILL, SEND_SIG_FORCED, vtsk, true);
@@ -265,6 +534,8 @@ static void scan_and_kill(void)
 	nr_victims = 0;
 	nr_killed = (atomic_t)ATOMIC_INIT(0);
 	write_unlock(&mm_free_lock);
+
+	return nr_to_kill;
 }
 
 static int simple_lmk_reclaim_thread(void *data)
@@ -277,9 +548,21 @@ static int simple_lmk_reclaim_thread(void *data)
 	set_freezable();
 
 	while (1) {
+		int nr;
+
 		wait_event_freezable(oom_waitq, atomic_read(&needs_reclaim));
-		scan_and_kill();
-		atomic_set_release(&needs_reclaim, 0);
+		if (atomic_read(&needs_reclaim) == RECLAIM_PREDICTIVE) {
+			nr = scan_and_kill(max(READ_ONCE(predict_batch_mb), 1U) *
+					   (SZ_1M / PAGE_SIZE));
+			WRITE_ONCE(nr_predictive_runs, nr_predictive_runs + 1);
+			WRITE_ONCE(nr_predictive_kills,
+				   nr_predictive_kills + nr);
+		} else {
+			nr = scan_and_kill(MIN_FREE_PAGES);
+			WRITE_ONCE(nr_reactive_runs, nr_reactive_runs + 1);
+			WRITE_ONCE(nr_reactive_kills, nr_reactive_kills + nr);
+		}
+		atomic_set_release(&needs_reclaim, RECLAIM_NONE);
 	}
 
 	return 0;
@@ -304,10 +587,92 @@ void simple_lmk_mm_freed(struct mm_struct *mm)
 	read_unlock(&mm_free_lock);
 }
 
+static unsigned long high_wmark_total(void)
+{
+	unsigned long pages = 0;
+	struct zone *zone;
+
+	for_each_populated_zone(zone)
+		pages += high_wmark_pages(zone);
+
+	return pages;
+}
+
+/* Update the prediction model and return true if a pre-kill is warranted */
+static bool simple_lmk_predict(unsigned long pressure)
+{
+	unsigned long now = jiffies, elapsed;
+	bool prekill = false;
+
+	/* Don't hold up reclaim if another CPU is already sampling */
+	if (!spin_trylock(&pm.lock))
+		return false;
+
+	pm.pressure = (pm.pressure * 3 + pressure) / 4;
+
+	elapsed = now - pm.last_sample;
+	if (elapsed < PREDICT_SAMPLE_INTERVAL)
+		goto unlock;
+
+	pm.last_sample = now;
+	pm.nr_samples++;
+	pm.wmark = high_wmark_total();
+	if (total_swap_pages > 0)
+		pm.swap_pct = 100 - get_nr_swap_pages() * 100 / total_swap_pages;
+	else
+		pm.swap_pct = 100;
+
+	/* Track the rate of decline of free pages in pages per second */
+	if (pm.free) {
+		long delta = (long)pm.free -
+			     (long)global_zone_page_state(NR_FREE_PAGES);
+
+		pm.rate += (delta * HZ / (long)elapsed - pm.rate) / 4;
+	}
+	pm.free = global_zone_page_state(NR_FREE_PAGES);
+
+	if (pm.rate <= 0)
+		pm.eta_ms = ULONG_MAX;
+	else if (pm.free > pm.wmark)
+		pm.eta_ms = (pm.free - pm.wmark) * MSEC_PER_SEC / pm.rate;
+	else
+		pm.eta_ms = 0;
+
+	if (!READ_ONCE(predict_enable) ||
+	    pm.pressure < READ_ONCE(predict_min_pressure) ||
+	    pm.swap_pct < READ_ONCE(predict_swap_pct) ||
+	    pm.eta_ms > READ_ONCE(predict_horizon_ms))
+		goto unlock;
+
+	/* Don't let a sustained trend turn into a kill storm */
+	if (pm.last_kill && time_before(now, pm.last_kill +
+			msecs_to_jiffies(READ_ONCE(predict_cooldown_ms)))) {
+		pm.nr_cooldown++;
+		goto unlock;
+	}
+
+	pm.last_kill = now;
+	pm.nr_predicted++;
+	prekill = true;
+unlock:
+	spin_unlock(&pm.lock);
+	return prekill;
+}
+
 static int simple_lmk_vmpressure_cb(struct notifier_block *nb,
 				    unsigned long pressure, void *data)
 {
-	if (pressure == 100 && !atomic_cmpxchg_acquire(&needs_reclaim, 0, 1))
+	bool prekill = simple_lmk_predict(pressure);
+	int type;
+
+	if (pressure == 100)
+		type = RECLAIM_REACTIVE;
+	else if (prekill)
+		type = RECLAIM_PREDICTIVE;
+	else
+		return NOTIFY_OK;
+
+	if (!atomic_cmpxchg_acquire(&needs_reclaim, RECLAIM_NONE, type))
 		wake_up(&oom_waitq);
 
 	return NOTIFY_OK;
@@ -330,11 +695,66 @@ static int simple_lmk_init_set(const char *val, const struct kernel_param *kp)
 						   NULL, "simple_lmkd");
 		BUG_ON(IS_ERR(thread));
 		BUG_ON(vmpressure_notifier_register(&vmpressure_notif));
+		/* Pairs with smp_load_acquire() in simple_lmk_adj_changed() */
+		smp_store_release(&victim_index_active, true);
+		queue_delayed_work(system_unbound_wq, &victim_sample_work, 0);
 	}
 
 	return 0;
 }
 
+static int simple_lmk_predict_show(struct seq_file *m, void *unused)
+{
+	spin_lock(&pm.lock);
+	seq_printf(m, "free_pages: %lu\n", pm.free);
+	seq_printf(m, "high_wmark_pages: %lu\n", pm.wmark);
+	seq_printf(m, "decline_rate: %ld pages/s\n", pm.rate);
+	if (pm.eta_ms == ULONG_MAX)
+		seq_puts(m, "eta: none\n");
+	else
+		seq_printf(m, "eta: %lu ms\n", pm.eta_ms);
+	seq_printf(m, "pressure: %u\n", pm.pressure);
+	seq_printf(m, "swap_fill: %u%%\n", pm.swap_pct);
+	seq_printf(m, "samples: %lu\n", pm.nr_samples);
+	seq_printf(m, "predicted: %lu\n", pm.nr_predicted);
+	seq_printf(m, "cooldown_skipped: %lu\n", pm.nr_cooldown);
+	spin_unlock(&pm.lock);
+
+	seq_printf(m, "reactive_runs: %lu\n", READ_ONCE(nr_reactive_runs));
+	seq_printf(m, "reactive_kills: %lu\n", READ_ONCE(nr_reactive_kills));
+	seq_printf(m, "predictive_runs: %lu\n", READ_ONCE(nr_predictive_runs));
+	seq_printf(m, "predictive_kills: %lu\n",
+		   READ_ONCE(nr_predictive_kills));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(simple_lmk_predict);
+
+static int __init simple_lmk_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("simple_lmk", NULL);
+	if (!dir)
+		return 0;
+
+	debugfs_create_file("predict", 0444, dir, NULL,
+			    &simple_lmk_predict_fops);
+	return 0;
+}
+late_initcall(simple_lmk_debugfs_init);
+
+static int __init simple_lmk_index_init(void)
+{
+	int i;
+
+	/* Must be ready before userspace can write any oom_score_adj */
+	for (i = 0; i < NR_BUCKETS; i++)
+		INIT_LIST_HEAD(&victim_buckets[i]);
+
+	return 0;
+}
+core_initcall(simple_lmk_index_init);
+
 static const struct kernel_param_ops simple_lmk_init_ops = {
 	.set = simple_lmk_init_set
 };
@@ -9,7 +9,11 @@
 
 #include <linux/vmalloc.h>
 #include <linux/xxhash.h>
+#include <linux/hash.h>
 #include <linux/highmem.h>
+#include <linux/rculist.h>
+#include <linux/log2.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -18,6 +22,19 @@
 #define ZRAM_HASH_SIZE_MIN	(1 << 10)
 #define ZRAM_HASH_SIZE_MAX	(1 << 31)
 
+/* Fingerprint is taken over this many cache lines spread over the page */
+#define ZRAM_FP_SAMPLES		8
+#define ZRAM_FP_SAMPLE_SIZE	64
+
+/*
+ * Bloom prefilter: ZRAM_BLOOM_BITS_PER_PAGE bits per disk page, two bits
+ * per fingerprint. Removed entries can't be cleared from it, so it is
+ * rebuilt from the live entries once the number of insertions since the
+ * last rebuild reaches 1/ZRAM_BLOOM_REBUILD_RATIO of its size.
+ */
+#define ZRAM_BLOOM_BITS_PER_PAGE	4
+#define ZRAM_BLOOM_REBUILD_RATIO	8
+
 u64 zram_dedup_dup_size(struct zram *zram)
 {
 	return (u64)atomic64_read(&zram->stats.dup_data_size);
@@ -33,37 +50,133 @@ static u64 zram_dedup_checksum(unsigned char *mem)
 	return xxh64(mem, PAGE_SIZE, 0);
 }
 
+static u64 zram_dedup_fingerprint(unsigned char *mem)
+{
+	struct xxh64_state state;
+	int i;
+
+	xxh64_reset(&state, 0);
+	for (i = 0; i < ZRAM_FP_SAMPLES; i++)
+		xxh64_update(&state, mem + i * (PAGE_SIZE / ZRAM_FP_SAMPLES),
+				ZRAM_FP_SAMPLE_SIZE);
+
+	return xxh64_digest(&state);
+}
+
+static struct zram_hash *zram_dedup_bucket(struct zram *zram, u64 fingerprint)
+{
+	return &zram->hash[fingerprint % zram->hash_size];
+}
+
+/*
+ * The two bit indexes: the low bits of the fingerprint, and a multiplicative
+ * hash that mixes in all 64 bits, so that every bit of the fingerprint
+ * counts whatever the filter size.
+ */
+static void zram_bloom_set(struct zram *zram, unsigned long *bloom,
+				u64 fingerprint)
+{
+	unsigned long mask = (1UL << zram->bloom_shift) - 1;
+
+	set_bit(fingerprint & mask, bloom);
+	set_bit(hash_64(fingerprint, zram->bloom_shift), bloom);
+}
+
+static bool zram_bloom_test(struct zram *zram, u64 fingerprint)
+{
+	unsigned long mask = (1UL << zram->bloom_shift) - 1;
+	unsigned long *bloom;
+	bool ret;
+
+	rcu_read_lock();
+	bloom = rcu_dereference(zram->bloom);
+	ret = test_bit(fingerprint & mask, bloom) &&
+		test_bit(hash_64(fingerprint, zram->bloom_shift), bloom);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static void zram_bloom_add(struct zram *zram, u64 fingerprint)
+{
+	unsigned long *next;
+	long inserts;
+
+	/*
+	 * Look at bloom_next first. If it is not set yet, the rebuild's first
+	 * synchronize_rcu() waits for us, and its walk finds the entry, which
+	 * is hashed before we get here. If it has already been cleared, the
+	 * barrier pairs with the rebuild's and bloom is the new filter.
+	 */
+	rcu_read_lock();
+	next = rcu_dereference(zram->bloom_next);
+	smp_rmb();
+	zram_bloom_set(zram, rcu_dereference(zram->bloom), fingerprint);
+	if (next)
+		zram_bloom_set(zram, next, fingerprint);
+	rcu_read_unlock();
+
+	inserts = atomic_long_inc_return(&zram->bloom_inserts);
+	if (inserts >= (1L << zram->bloom_shift) / ZRAM_BLOOM_REBUILD_RATIO)
+		schedule_work(&zram->bloom_work);
+}
+
+/*
+ * Build a fresh filter from the entries currently hashed and swap it in.
+ * Insertions racing with the walk set their bits in both filters.
+ */
+static void zram_bloom_rebuild(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, bloom_work);
+	struct zram_entry *entry;
+	unsigned long *new, *old;
+	size_t i;
+
+	new = vzalloc(BITS_TO_LONGS(1UL << zram->bloom_shift) * sizeof(long));
+	if (!new) {
+		atomic_long_set(&zram->bloom_inserts, 0);
+		return;
+	}
+
+	rcu_assign_pointer(zram->bloom_next, new);
+	/* every insertion after this either sees bloom_next or is hashed */
+	synchronize_rcu();
+	atomic_long_set(&zram->bloom_inserts, 0);
+
+	for (i = 0; i < zram->hash_size; i++) {
+		rcu_read_lock();
+		hlist_for_each_entry_rcu(entry, &zram->hash[i].head, node)
+			zram_bloom_set(zram, new, entry->fingerprint);
+		rcu_read_unlock();
+		cond_resched();
+	}
+
+	old = rcu_dereference_protected(zram->bloom, 1);
+	rcu_assign_pointer(zram->bloom, new);
+	/* pairs with smp_rmb() in zram_bloom_add() */
+	smp_wmb();
+	RCU_INIT_POINTER(zram->bloom_next, NULL);
+	synchronize_rcu();
+	vfree(old);
+}
+
 void zram_dedup_insert(struct zram *zram, struct zram_entry *new,
-				u64 checksum)
+				struct zram_dedup_key *key)
 {
 	struct zram_hash *hash;
-	struct rb_root *rb_root;
-	struct rb_node **rb_node, *parent = NULL;
-	struct zram_entry *entry;
 
 	if (!zram_dedup_enabled(zram))
 		return;
 
-	new->checksum = checksum;
-	hash = &zram->hash[checksum % zram->hash_size];
-	rb_root = &hash->rb_root;
+	new->fingerprint = key->fingerprint;
+	new->checksum = key->checksum;
+	hash = zram_dedup_bucket(zram, key->fingerprint);
 
 	spin_lock(&hash->lock);
-	rb_node = &rb_root->rb_node;
-	while (*rb_node) {
-		parent = *rb_node;
-		entry = rb_entry(parent, struct zram_entry, rb_node);
-		if (checksum < entry->checksum)
-			rb_node = &parent->rb_left;
-		else if (checksum > entry->checksum)
-			rb_node = &parent->rb_right;
-		else
-			rb_node = &parent->rb_left;
-	}
-
-	rb_link_node(&new->rb_node, parent, rb_node);
-	rb_insert_color(&new->rb_node, rb_root);
+	hlist_add_head_rcu(&new->node, &hash->head);
 	spin_unlock(&hash->lock);
+
+	zram_bloom_add(zram, key->fingerprint);
 }
 
 static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
@@ -91,109 +204,94 @@ static unsigned long zram_dedup_put(struct zram *zram,
 				struct zram_entry *entry)
 {
 	struct zram_hash *hash;
-	u64 checksum;
 	unsigned long val;
 
-	checksum = entry->checksum;
-	hash = &zram->hash[checksum % zram->hash_size];
-
-	spin_lock(&hash->lock);
-
-	val = --entry->refcount;
-	if (!entry->refcount)
-		rb_erase(&entry->rb_node, &hash->rb_root);
-	else
+	val = atomic_long_dec_return(&entry->refcount);
+	if (val) {
 		atomic64_sub(entry->len, &zram->stats.dup_data_size);
-
-	spin_unlock(&hash->lock);
-
-	return val;
-}
-
-static struct zram_entry *__zram_dedup_get(struct zram *zram,
-				struct zram_hash *hash, unsigned char *mem,
-				struct zram_entry *entry)
-{
-	struct zram_entry *tmp, *prev = NULL;
-	struct rb_node *rb_node;
-
-	/* find left-most entry with same checksum */
-	while ((rb_node = rb_prev(&entry->rb_node))) {
-		tmp = rb_entry(rb_node, struct zram_entry, rb_node);
-		if (tmp->checksum != entry->checksum)
-			break;
-
-		entry = tmp;
+		return val;
 	}
 
-again:
-	entry->refcount++;
-	atomic64_add(entry->len, &zram->stats.dup_data_size);
-	spin_unlock(&hash->lock);
-
-	if (prev)
-		zram_entry_free(zram, prev);
-
-	if (zram_dedup_match(zram, entry, mem))
-		return entry;
-
-	spin_lock(&hash->lock);
-	tmp = NULL;
-	rb_node = rb_next(&entry->rb_node);
-	if (rb_node)
-		tmp = rb_entry(rb_node, struct zram_entry, rb_node);
-
-	if (tmp && (tmp->checksum == entry->checksum)) {
-		prev = entry;
-		entry = tmp;
-		goto again;
+	/* entries which failed before insertion were never hashed */
+	if (!hlist_unhashed(&entry->node)) {
+		hash = zram_dedup_bucket(zram, entry->fingerprint);
+		spin_lock(&hash->lock);
+		hlist_del_rcu(&entry->node);
+		spin_unlock(&hash->lock);
 	}
 
-	spin_unlock(&hash->lock);
-	zram_entry_free(zram, entry);
-
-	return NULL;
+	return 0;
 }
 
+/*
+ * Walk the bucket without its lock. An entry can only be used once a
+ * reference has been taken on it, and one whose refcount already dropped
+ * to zero is being removed and is skipped. Entry memory is RCU-freed, so
+ * the walk may safely continue past an entry we have released.
+ */
 static struct zram_entry *zram_dedup_get(struct zram *zram,
-				unsigned char *mem, u64 checksum)
+				unsigned char *mem, struct zram_dedup_key *key)
 {
 	struct zram_hash *hash;
 	struct zram_entry *entry;
-	struct rb_node *rb_node;
 
-	hash = &zram->hash[checksum % zram->hash_size];
-
-	spin_lock(&hash->lock);
-	rb_node = hash->rb_root.rb_node;
-	while (rb_node) {
-		entry = rb_entry(rb_node, struct zram_entry, rb_node);
-		if (checksum == entry->checksum)
-			return __zram_dedup_get(zram, hash, mem, entry);
-
-		if (checksum < entry->checksum)
-			rb_node = rb_node->rb_left;
-		else
-			rb_node = rb_node->rb_right;
+	hash = zram_dedup_bucket(zram, key->fingerprint);
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(entry, &hash->head, node) {
+		/*
+		 * An entry inserted on a prefilter miss has no full checksum
+		 * and can only be told apart by comparing the data.
+		 */
+		if (entry->fingerprint != key->fingerprint ||
+		    (entry->checksum && entry->checksum != key->checksum)) {
+			atomic64_inc(&zram->stats.dedup_collision);
+			continue;
+		}
+
+		if (!atomic_long_inc_not_zero(&entry->refcount))
+			continue;
+
+		atomic64_add(entry->len, &zram->stats.dup_data_size);
+		if (zram_dedup_match(zram, entry, mem)) {
+			rcu_read_unlock();
+			atomic64_inc(&zram->stats.dedup_hit);
+			return entry;
+		}
+
+		zram_entry_free(zram, entry);
 	}
-	spin_unlock(&hash->lock);
+	rcu_read_unlock();
 
+	atomic64_inc(&zram->stats.dedup_miss);
 	return NULL;
 }
 
 struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
-				u64 *checksum)
+				struct zram_dedup_key *key)
 {
 	void *mem;
-	struct zram_entry *entry;
+	struct zram_entry *entry = NULL;
 
 	if (!zram_dedup_enabled(zram))
 		return NULL;
 
 	mem = kmap_atomic(page);
-	*checksum = zram_dedup_checksum(mem);
+	key->fingerprint = zram_dedup_fingerprint(mem);
+	key->checksum = 0;
 
-	entry = zram_dedup_get(zram, mem, *checksum);
+	if (!zram_bloom_test(zram, key->fingerprint)) {
+		atomic64_inc(&zram->stats.dedup_prefilter_skip);
+		atomic64_inc(&zram->stats.dedup_miss);
+		goto out;
+	}
+
+	atomic64_inc(&zram->stats.dedup_prefilter_pass);
+	key->checksum = zram_dedup_checksum(mem);
+	entry = zram_dedup_get(zram, mem, key);
+	if (!entry)
+		atomic64_inc(&zram->stats.dedup_prefilter_false);
+out:
 	kunmap_atomic(mem);
 
 	return entry;
@@ -206,7 +304,7 @@ void zram_dedup_init_entry(struct zram *zram, struct zram_entry *entry,
 		return;
 
 	entry->handle = handle;
-	entry->refcount = 1;
+	atomic_long_set(&entry->refcount, 1);
 	entry->len = len;
 }
 
@@ -241,14 +339,35 @@ int zram_dedup_init(struct zram *zram, size_t num_pages)
 	for (i = 0; i < zram->hash_size; i++) {
 		hash = &zram->hash[i];
 		spin_lock_init(&hash->lock);
-		hash->rb_root = RB_ROOT;
+		INIT_HLIST_HEAD(&hash->head);
+	}
+
+	zram->bloom_shift = ilog2(roundup_pow_of_two(max_t(size_t, num_pages,
+				ZRAM_HASH_SIZE_MIN) * ZRAM_BLOOM_BITS_PER_PAGE));
+	RCU_INIT_POINTER(zram->bloom, vzalloc(BITS_TO_LONGS(1UL <<
+				zram->bloom_shift) * sizeof(long)));
+	if (!rcu_access_pointer(zram->bloom)) {
+		pr_err("Error allocating zram dedup bloom filter\n");
+		vfree(zram->hash);
+		zram->hash = NULL;
+		return -ENOMEM;
 	}
+	RCU_INIT_POINTER(zram->bloom_next, NULL);
+	atomic_long_set(&zram->bloom_inserts, 0);
+	INIT_WORK(&zram->bloom_work, zram_bloom_rebuild);
 
 	return 0;
 }
 
 void zram_dedup_fini(struct zram *zram)
 {
+	if (!zram->hash)
+		return;
+
+	cancel_work_sync(&zram->bloom_work);
+	vfree(rcu_dereference_protected(zram->bloom, 1));
+	RCU_INIT_POINTER(zram->bloom, NULL);
+
 	vfree(zram->hash);
 	zram->hash = NULL;
 	zram->hash_size = 0;
@@ -4,15 +4,26 @@
 struct zram;
 struct zram_entry;
 
+/*
+ * Dedup keys are computed in two stages: a cheap fingerprint over a few
+ * sampled cache lines, which selects the bucket and feeds the bloom
+ * prefilter, and the full page checksum, which is only computed once the
+ * prefilter reports a possible duplicate.
+ */
+struct zram_dedup_key {
+	u64 fingerprint;
+	u64 checksum;	/* 0 if not computed */
+};
+
 #ifdef CONFIG_ZRAM_DEDUP
 
 u64 zram_dedup_dup_size(struct zram *zram);
 u64 zram_dedup_meta_size(struct zram *zram);
 
 void zram_dedup_insert(struct zram *zram, struct zram_entry *new,
-				u64 checksum);
+				struct zram_dedup_key *key);
 struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
-				u64 *checksum);
+				struct zram_dedup_key *key);
 
 void zram_dedup_init_entry(struct zram *zram, struct zram_entry *entry,
 				unsigned long handle, unsigned int len);
@@ -26,9 +37,10 @@ static inline u64 zram_dedup_dup_size(struct zram *zram) { return 0; }
 static inline u64 zram_dedup_meta_size(struct zram *zram) { return 0; }
 
 static inline void zram_dedup_insert(struct zram *zram, struct zram_entry *new,
-			u64 checksum) { }
+			struct zram_dedup_key *key) { }
 static inline struct zram_entry *zram_dedup_find(struct zram *zram,
-			struct page *page, u64 *checksum) { return NULL; }
+			struct page *page, struct zram_dedup_key *key)
+			{ return NULL; }
 
 static inline void zram_dedup_init_entry(struct zram *zram,
 			struct zram_entry *entry, unsigned long handle,
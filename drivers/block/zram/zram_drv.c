@@ -142,6 +142,30 @@ static inline bool zram_allocated(struct zram *zram, u32 index)
 			zram_test_flag(zram, index, ZRAM_WB);
 }
 
+/* Compression backend the slot's object was produced with */
+static struct zcomp *zram_slot_comp(struct zram *zram, u32 index)
+{
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram_test_flag(zram, index, ZRAM_RECOMP))
+		return zram->recomp;
+#endif
+	return zram->comp;
+}
+
+/*
+ * Wait until an asynchronous write queued for the slot has been published.
+ * Called with the slot's bit_spinlock held, which is dropped while waiting.
+ */
+static void zram_wait_pending(struct zram *zram, u32 index)
+{
+	while (zram_test_flag(zram, index, ZRAM_UNDER_COMP)) {
+		zram_slot_unlock(zram, index);
+		wait_event(zram->comp_wait,
+			   !zram_test_flag(zram, index, ZRAM_UNDER_COMP));
+		zram_slot_lock(zram, index);
+	}
+}
+
 #if PAGE_SIZE != 4096
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
@@ -392,6 +416,187 @@ static ssize_t writeback_limit_show(struct device *dev,
 	return scnprintf(buf, PAGE_SIZE, "%llu\n", val);
 }
 
+/*
+ * Writeback allocates block runs in slot order, so blocks next to each
+ * other on the backing device hold pages that were next to each other in
+ * zram. When a read misses on a written back slot, the following blocks
+ * are read as well into a small direct-mapped cache keyed by block index.
+ */
+#define ZRAM_RA_CACHE_PAGES	32
+#define ZRAM_RA_WINDOW		8
+
+#define ZRAM_RA_EMPTY	0
+#define ZRAM_RA_PENDING	1
+#define ZRAM_RA_VALID	2
+
+static struct zram_ra_entry *zram_ra_entry(struct zram *zram,
+				unsigned long blk_idx)
+{
+	return &zram->ra_cache[blk_idx % ZRAM_RA_CACHE_PAGES];
+}
+
+static void zram_ra_free(struct zram_ra_entry *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < ZRAM_RA_CACHE_PAGES; i++) {
+		if (cache[i].page)
+			__free_page(cache[i].page);
+	}
+	kfree(cache);
+}
+
+static struct zram_ra_entry *zram_ra_alloc(void)
+{
+	struct zram_ra_entry *cache;
+	int i;
+
+	cache = kcalloc(ZRAM_RA_CACHE_PAGES, sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return NULL;
+
+	for (i = 0; i < ZRAM_RA_CACHE_PAGES; i++) {
+		cache[i].page = alloc_page(GFP_KERNEL);
+		if (!cache[i].page) {
+			zram_ra_free(cache);
+			return NULL;
+		}
+		set_page_private(cache[i].page, i);
+	}
+
+	return cache;
+}
+
+/*
+ * Drop the cached copy of a block which is freed or rewritten. A pending
+ * read keeps its page until it completes, so it is only marked stale.
+ */
+static void zram_ra_invalidate(struct zram *zram, unsigned long blk_idx)
+{
+	struct zram_ra_entry *e;
+	unsigned long flags;
+
+	if (!zram->ra_cache)
+		return;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	e = zram_ra_entry(zram, blk_idx);
+	if (e->blk_idx == blk_idx) {
+		if (e->state == ZRAM_RA_PENDING)
+			e->blk_idx = 0;
+		else
+			e->state = ZRAM_RA_EMPTY;
+	}
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+}
+
+static bool zram_ra_lookup(struct zram *zram, struct bio_vec *bvec,
+				unsigned long blk_idx)
+{
+	struct zram_ra_entry *e;
+	unsigned long flags;
+	bool hit = false;
+
+	if (!zram->ra_cache)
+		return false;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	e = zram_ra_entry(zram, blk_idx);
+	if (e->blk_idx == blk_idx && e->state == ZRAM_RA_VALID) {
+		void *src = kmap_atomic(e->page);
+		void *dst = kmap_atomic(bvec->bv_page);
+
+		memcpy(dst + bvec->bv_offset, src, bvec->bv_len);
+		kunmap_atomic(dst);
+		kunmap_atomic(src);
+		hit = true;
+	}
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+
+	if (hit)
+		atomic64_inc(&zram->stats.bd_ra_hits);
+	return hit;
+}
+
+static void zram_ra_end_io(struct bio *bio)
+{
+	struct zram *zram = bio->bi_private;
+	struct bio_vec *bv;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	bio_for_each_segment_all(bv, bio, i) {
+		struct zram_ra_entry *e;
+
+		e = &zram->ra_cache[page_private(bv->bv_page)];
+		if (!bio->bi_status && e->blk_idx)
+			e->state = ZRAM_RA_VALID;
+		else
+			e->state = ZRAM_RA_EMPTY;
+	}
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+
+	bio_put(bio);
+	if (atomic_dec_and_test(&zram->ra_inflight))
+		wake_up(&zram->ra_wait);
+}
+
+/* Read ahead the run of written back blocks starting at @blk_idx */
+static void zram_ra_prefetch(struct zram *zram, unsigned long blk_idx)
+{
+	struct zram_ra_entry *e;
+	unsigned long flags, end;
+	struct bio *bio;
+	int i, nr = 0;
+
+	if (!zram->ra_cache)
+		return;
+
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	end = min(zram->nr_pages, blk_idx + ZRAM_RA_WINDOW);
+	for (; blk_idx + nr < end; nr++) {
+		e = zram_ra_entry(zram, blk_idx + nr);
+		if (!test_bit(blk_idx + nr, zram->bitmap) ||
+				e->state == ZRAM_RA_PENDING ||
+				(e->state == ZRAM_RA_VALID &&
+				 e->blk_idx == blk_idx + nr))
+			break;
+		e->blk_idx = blk_idx + nr;
+		e->state = ZRAM_RA_PENDING;
+	}
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+
+	if (!nr)
+		return;
+
+	bio = bio_alloc(GFP_ATOMIC, nr);
+	if (!bio)
+		goto fail;
+
+	bio->bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
+	bio_set_dev(bio, zram->bdev);
+	bio->bi_opf = REQ_OP_READ | REQ_RAHEAD;
+	bio->bi_private = zram;
+	bio->bi_end_io = zram_ra_end_io;
+	for (i = 0; i < nr; i++)
+		bio_add_page(bio, zram_ra_entry(zram, blk_idx + i)->page,
+				PAGE_SIZE, 0);
+
+	atomic_inc(&zram->ra_inflight);
+	atomic64_add(nr, &zram->stats.bd_ra_reads);
+	submit_bio(bio);
+	return;
+fail:
+	spin_lock_irqsave(&zram->ra_lock, flags);
+	for (i = 0; i < nr; i++)
+		zram_ra_entry(zram, blk_idx + i)->state = ZRAM_RA_EMPTY;
+	spin_unlock_irqrestore(&zram->ra_lock, flags);
+}
+
 static void reset_bdev(struct zram *zram)
 {
 	struct block_device *bdev;
@@ -399,6 +604,9 @@ static void reset_bdev(struct zram *zram)
 	if (!zram->backing_dev)
 		return;
 
+	/* Readahead bios still use the bdev and the bitmap */
+	wait_event(zram->ra_wait, !atomic_read(&zram->ra_inflight));
+
 	bdev = zram->bdev;
 	if (zram->old_block_size)
 		set_blocksize(bdev, zram->old_block_size);
@@ -411,6 +619,9 @@ static void reset_bdev(struct zram *zram)
 
 	kvfree(zram->bitmap);
 	zram->bitmap = NULL;
+
+	zram_ra_free(zram->ra_cache);
+	zram->ra_cache = NULL;
 }
 
 static ssize_t backing_dev_show(struct device *dev,
@@ -453,6 +664,7 @@ static ssize_t backing_dev_store(struct device *dev,
 	struct address_space *mapping;
 	unsigned int bitmap_sz, old_block_size = 0;
 	unsigned long nr_pages, *bitmap = NULL;
+	struct zram_ra_entry *ra_cache = NULL;
 	struct block_device *bdev = NULL;
 	int err;
 	struct zram *zram = dev_to_zram(dev);
@@ -505,6 +717,12 @@ static ssize_t backing_dev_store(struct device *dev,
 		goto out;
 	}
 
+	ra_cache = zram_ra_alloc();
+	if (!ra_cache) {
+		err = -ENOMEM;
+		goto out;
+	}
+
 	old_block_size = block_size(bdev);
 	err = set_blocksize(bdev, PAGE_SIZE);
 	if (err)
@@ -517,6 +735,7 @@ static ssize_t backing_dev_store(struct device *dev,
 	zram->backing_dev = backing_dev;
 	zram->bitmap = bitmap;
 	zram->nr_pages = nr_pages;
+	zram->ra_cache = ra_cache;
 	up_write(&zram->init_lock);
 
 	pr_info("setup backing device %s\n", file_name);
@@ -524,6 +743,8 @@ static ssize_t backing_dev_store(struct device *dev,
 
 	return len;
 out:
+	zram_ra_free(ra_cache);
+
 	if (bitmap)
 		kvfree(bitmap);
 
@@ -540,19 +761,33 @@ static ssize_t backing_dev_store(struct device *dev,
 	return err;
 }
 
-static unsigned long alloc_block_bdev(struct zram *zram)
+/*
+ * Allocate a run of up to @want contiguous blocks starting at the first
+ * free one. Returns the first block and stores the run length in @nr, or
+ * returns 0 if the backing device is full.
+ */
+static unsigned long alloc_block_run_bdev(struct zram *zram,
+				unsigned int want, unsigned int *nr)
 {
-	unsigned long blk_idx = 1;
+	unsigned long blk_idx = 1, end, i;
 retry:
 	/* skip 0 bit to confuse zram.handle = 0 */
 	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, blk_idx);
 	if (blk_idx == zram->nr_pages)
 		return 0;
 
-	if (test_and_set_bit(blk_idx, zram->bitmap))
-		goto retry;
+	end = find_next_bit(zram->bitmap,
+			min(zram->nr_pages, blk_idx + want), blk_idx);
+	for (i = blk_idx; i < end; i++) {
+		if (test_and_set_bit(i, zram->bitmap)) {
+			while (i-- > blk_idx)
+				clear_bit(i, zram->bitmap);
+			goto retry;
+		}
+	}
 
-	atomic64_inc(&zram->stats.bd_count);
+	atomic64_add(end - blk_idx, &zram->stats.bd_count);
+	*nr = end - blk_idx;
 	return blk_idx;
 }
 
@@ -560,6 +795,7 @@ static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
 {
 	int was_set;
 
+	zram_ra_invalidate(zram, blk_idx);
 	was_set = test_and_clear_bit(blk_idx, zram->bitmap);
 	WARN_ON_ONCE(!was_set);
 	atomic64_dec(&zram->stats.bd_count);
@@ -608,18 +844,174 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 #define HUGE_WRITEBACK 1
 #define IDLE_WRITEBACK 2
 
+/*
+ * Writeback builds bios of up to ZRAM_WB_BATCH_PAGES pages targeting a
+ * contiguous run of blocks and keeps up to ZRAM_WB_MAX_INFLIGHT of them
+ * in flight while the next batch is being read out of zsmalloc.
+ */
+#define ZRAM_WB_BATCH_PAGES	32
+#define ZRAM_WB_MAX_INFLIGHT	4
+
+struct zram_wb_batch {
+	struct page *pages[ZRAM_WB_BATCH_PAGES];
+	u32 index[ZRAM_WB_BATCH_PAGES];
+	unsigned int nr;		/* pages filled */
+	unsigned int nr_blocks;		/* blocks reserved from blk_idx */
+	unsigned long blk_idx;
+	struct bio *bio;
+	struct completion done;
+};
+
+static void zram_wb_limit_charge(struct zram *zram, long pages)
+{
+	spin_lock(&zram->wb_limit_lock);
+	if (zram->wb_limit_enable)
+		zram->bd_wb_limit -= pages * (1L << (PAGE_SHIFT - 12));
+	spin_unlock(&zram->wb_limit_lock);
+}
+
+static bool zram_wb_limit_reached(struct zram *zram)
+{
+	bool ret;
+
+	spin_lock(&zram->wb_limit_lock);
+	ret = zram->wb_limit_enable &&
+		zram->bd_wb_limit < (1UL << (PAGE_SHIFT - 12));
+	spin_unlock(&zram->wb_limit_lock);
+
+	return ret;
+}
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_batch *wb = bio->bi_private;
+
+	complete(&wb->done);
+}
+
+static void zram_wb_submit(struct zram *zram, struct zram_wb_batch *wb)
+{
+	struct bio *bio;
+	unsigned int i;
+
+	bio = bio_alloc(GFP_KERNEL, wb->nr);
+	bio_set_dev(bio, zram->bdev);
+	bio->bi_iter.bi_sector = wb->blk_idx * (PAGE_SIZE >> 9);
+	bio->bi_opf = REQ_OP_WRITE;
+	bio->bi_private = wb;
+	bio->bi_end_io = zram_wb_end_io;
+	for (i = 0; i < wb->nr; i++)
+		bio_add_page(bio, wb->pages[i], PAGE_SIZE, 0);
+
+	wb->bio = bio;
+	atomic64_inc(&zram->stats.bd_wb_bios);
+	submit_bio(bio);
+}
+
+/*
+ * Wait for a submitted batch and switch its slots over to the backing
+ * device. Blocks which ended up unused are released.
+ */
+static void zram_wb_complete(struct zram *zram, struct zram_wb_batch *wb)
+{
+	blk_status_t status = BLK_STS_OK;
+	unsigned int i;
+
+	if (wb->bio) {
+		wait_for_completion(&wb->done);
+		status = wb->bio->bi_status;
+		bio_put(wb->bio);
+		wb->bio = NULL;
+	}
+
+	for (i = 0; i < wb->nr; i++) {
+		u32 index = wb->index[i];
+
+		zram_slot_lock(zram, index);
+		/*
+		 * We released zram_slot_lock so need to check if the slot was
+		 * changed. If there is freeing for the slot, we can catch it
+		 * easily by zram_allocated.
+		 * A subtle case is the slot is freed/reallocated/marked as
+		 * ZRAM_IDLE again. To close the race, idle_store doesn't
+		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 */
+		if (status || !zram_allocated(zram, index) ||
+			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			zram_slot_unlock(zram, index);
+			free_block_bdev(zram, wb->blk_idx + i);
+			zram_wb_limit_charge(zram, -1);
+			continue;
+		}
+
+		/* readahead may have caught the block before it was written */
+		zram_ra_invalidate(zram, wb->blk_idx + i);
+		zram_free_page(zram, index);
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_set_element(zram, index, wb->blk_idx + i);
+		atomic64_inc(&zram->stats.pages_stored);
+		zram_slot_unlock(zram, index);
+		atomic64_inc(&zram->stats.bd_writes);
+	}
+
+	for (i = wb->nr; i < wb->nr_blocks; i++)
+		free_block_bdev(zram, wb->blk_idx + i);
+
+	wb->nr = 0;
+	wb->nr_blocks = 0;
+	reinit_completion(&wb->done);
+}
+
+static void zram_wb_free_batches(struct zram_wb_batch *wbs)
+{
+	int i, j;
+
+	for (i = 0; i < ZRAM_WB_MAX_INFLIGHT; i++) {
+		for (j = 0; j < ZRAM_WB_BATCH_PAGES; j++) {
+			if (wbs[i].pages[j])
+				__free_page(wbs[i].pages[j]);
+		}
+	}
+	kfree(wbs);
+}
+
+static struct zram_wb_batch *zram_wb_alloc_batches(void)
+{
+	struct zram_wb_batch *wbs;
+	int i, j;
+
+	wbs = kcalloc(ZRAM_WB_MAX_INFLIGHT, sizeof(*wbs), GFP_KERNEL);
+	if (!wbs)
+		return NULL;
+
+	for (i = 0; i < ZRAM_WB_MAX_INFLIGHT; i++) {
+		init_completion(&wbs[i].done);
+		for (j = 0; j < ZRAM_WB_BATCH_PAGES; j++) {
+			wbs[i].pages[j] = alloc_page(GFP_KERNEL);
+			if (!wbs[i].pages[j]) {
+				zram_wb_free_batches(wbs);
+				return NULL;
+			}
+		}
+	}
+
+	return wbs;
+}
+
 static ssize_t writeback_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	struct zram *zram = dev_to_zram(dev);
 	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
 	unsigned long index;
-	struct bio bio;
-	struct bio_vec bio_vec;
-	struct page *page;
-	ssize_t ret;
-	int mode;
-	unsigned long blk_idx = 0;
+	struct zram_wb_batch *wbs, *wb;
+	ktime_t start_time;
+	ssize_t ret = len;
+	int mode, cur = 0;
 
 	if (sysfs_streq(buf, "idle"))
 		mode = IDLE_WRITEBACK;
@@ -639,30 +1031,26 @@ static ssize_t writeback_store(struct device *dev,
 		goto release_init_lock;
 	}
 
-	page = alloc_page(GFP_KERNEL);
-	if (!page) {
+	wbs = zram_wb_alloc_batches();
+	if (!wbs) {
 		ret = -ENOMEM;
 		goto release_init_lock;
 	}
 
+	start_time = ktime_get();
+	wb = &wbs[cur];
 	for (index = 0; index < nr_pages; index++) {
 		struct bio_vec bvec;
 
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
-
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && !zram->bd_wb_limit) {
-			spin_unlock(&zram->wb_limit_lock);
+		if (zram_wb_limit_reached(zram)) {
 			ret = -EIO;
 			break;
 		}
-		spin_unlock(&zram->wb_limit_lock);
 
-		if (!blk_idx) {
-			blk_idx = alloc_block_bdev(zram);
-			if (!blk_idx) {
+		if (!wb->nr_blocks) {
+			wb->blk_idx = alloc_block_run_bdev(zram,
+					ZRAM_WB_BATCH_PAGES, &wb->nr_blocks);
+			if (!wb->blk_idx) {
 				ret = -ENOSPC;
 				break;
 			}
@@ -674,7 +1062,8 @@ static ssize_t writeback_store(struct device *dev,
 
 		if (zram_test_flag(zram, index, ZRAM_WB) ||
 				zram_test_flag(zram, index, ZRAM_SAME) ||
-				zram_test_flag(zram, index, ZRAM_UNDER_WB))
+				zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+				zram_test_flag(zram, index, ZRAM_UNDER_COMP))
 			goto next;
 
 		if (mode == IDLE_WRITEBACK &&
@@ -691,6 +1080,10 @@ static ssize_t writeback_store(struct device *dev,
 		/* Need for hugepage writeback racing */
 		zram_set_flag(zram, index, ZRAM_IDLE);
 		zram_slot_unlock(zram, index);
+
+		bvec.bv_page = wb->pages[wb->nr];
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
 		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
 			zram_slot_lock(zram, index);
 			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
@@ -699,62 +1092,30 @@ static ssize_t writeback_store(struct device *dev,
 			continue;
 		}
 
-		bio_init(&bio, &bio_vec, 1);
-		bio_set_dev(&bio, zram->bdev);
-		bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
-		bio.bi_opf = REQ_OP_WRITE | REQ_SYNC;
-
-		bio_add_page(&bio, bvec.bv_page, bvec.bv_len,
-				bvec.bv_offset);
-		/*
-		 * XXX: A single page IO would be inefficient for write
-		 * but it would be not bad as starter.
-		 */
-		ret = submit_bio_wait(&bio);
-		if (ret) {
-			zram_slot_lock(zram, index);
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			zram_slot_unlock(zram, index);
+		/* given back in zram_wb_complete if the page isn't stored */
+		zram_wb_limit_charge(zram, 1);
+		wb->index[wb->nr++] = index;
+		if (wb->nr < wb->nr_blocks)
 			continue;
-		}
-
-		atomic64_inc(&zram->stats.bd_writes);
-		/*
-		 * We released zram_slot_lock so need to check if the slot was
-		 * changed. If there is freeing for the slot, we can catch it
-		 * easily by zram_allocated.
-		 * A subtle case is the slot is freed/reallocated/marked as
-		 * ZRAM_IDLE again. To close the race, idle_store doesn't
-		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
-		 * Thus, we could close the race by checking ZRAM_IDLE bit.
-		 */
-		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index) ||
-			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			goto next;
-		}
 
-		zram_free_page(zram, index);
-		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-		zram_set_flag(zram, index, ZRAM_WB);
-		zram_set_element(zram, index, blk_idx);
-		blk_idx = 0;
-		atomic64_inc(&zram->stats.pages_stored);
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
-			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
-		spin_unlock(&zram->wb_limit_lock);
+		zram_wb_submit(zram, wb);
+		cur = (cur + 1) % ZRAM_WB_MAX_INFLIGHT;
+		wb = &wbs[cur];
+		zram_wb_complete(zram, wb);
+		continue;
 next:
 		zram_slot_unlock(zram, index);
 	}
 
-	if (blk_idx)
-		free_block_bdev(zram, blk_idx);
-	ret = len;
-	__free_page(page);
+	if (wb->nr)
+		zram_wb_submit(zram, wb);
+
+	for (cur = 0; cur < ZRAM_WB_MAX_INFLIGHT; cur++)
+		zram_wb_complete(zram, &wbs[cur]);
+
+	atomic64_add(ktime_ms_delta(ktime_get(), start_time),
+			&zram->stats.bd_wb_time);
+	zram_wb_free_batches(wbs);
 release_init_lock:
 	up_read(&zram->init_lock);
 
@@ -814,7 +1175,11 @@ static int read_from_bdev_sync(struct zram *zram, struct bio_vec *bvec,
 static int read_from_bdev(struct zram *zram, struct bio_vec *bvec,
 			unsigned long entry, struct bio *parent, bool sync)
 {
+	if (zram_ra_lookup(zram, bvec, entry))
+		return 0;
+
 	atomic64_inc(&zram->stats.bd_reads);
+	zram_ra_prefetch(zram, entry + 1);
 	if (sync)
 		return read_from_bdev_sync(zram, bvec, entry, parent);
 	else
@@ -1003,53 +1368,129 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
-static ssize_t use_dedup_show(struct device *dev,
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
-	bool val;
+	size_t sz;
 	struct zram *zram = dev_to_zram(dev);
 
 	down_read(&zram->init_lock);
-	val = zram->use_dedup;
+	sz = zcomp_available_show(zram->recompressor, buf);
 	up_read(&zram->init_lock);
 
-	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+	return sz;
 }
 
-#ifdef CONFIG_ZRAM_DEDUP
-static ssize_t use_dedup_store(struct device *dev,
+static ssize_t recomp_algorithm_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
-	int val;
 	struct zram *zram = dev_to_zram(dev);
+	char compressor[ARRAY_SIZE(zram->recompressor)];
+	size_t sz;
 
-	if (kstrtoint(buf, 10, &val) || (val != 0 && val != 1))
+	strlcpy(compressor, buf, sizeof(compressor));
+	/* ignore trailing newline */
+	sz = strlen(compressor);
+	if (sz > 0 && compressor[sz - 1] == '\n')
+		compressor[sz - 1] = 0x00;
+
+	if (!zcomp_available_algorithm(compressor))
 		return -EINVAL;
 
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		up_write(&zram->init_lock);
-		pr_info("Can't change dedup usage for initialized device\n");
+		pr_info("Can't change algorithm for initialized device\n");
 		return -EBUSY;
 	}
-	zram->use_dedup = val;
+
+	strcpy(zram->recompressor, compressor);
 	up_write(&zram->init_lock);
 	return len;
 }
 #endif
 
-static ssize_t compact_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t len)
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
+	bool val;
 	struct zram *zram = dev_to_zram(dev);
 
 	down_read(&zram->init_lock);
-	if (!init_done(zram)) {
-		up_read(&zram->init_lock);
-		return -EINVAL;
-	}
-
-	zs_compact(zram->mem_pool);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (kstrtoint(buf, 10, &val) || (val != 0 && val != 1))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+#endif
+
+static ssize_t async_comp_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->async_comp;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+static ssize_t async_comp_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (kstrtoint(buf, 10, &val) || (val != 0 && val != 1))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change async compression for initialized device\n");
+		return -EBUSY;
+	}
+	zram->async_comp = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	zs_compact(zram->mem_pool);
 	up_read(&zram->init_lock);
 
 	return len;
@@ -1063,11 +1504,13 @@ static ssize_t io_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8llu\n",
+			"%8llu %8llu %8llu %8llu %8llu %8llu\n",
 			(u64)atomic64_read(&zram->stats.failed_reads),
 			(u64)atomic64_read(&zram->stats.failed_writes),
 			(u64)atomic64_read(&zram->stats.invalid_io),
-			(u64)atomic64_read(&zram->stats.notify_free));
+			(u64)atomic64_read(&zram->stats.notify_free),
+			(u64)atomic64_read(&zram->stats.batch_writes),
+			(u64)atomic64_read(&zram->stats.batch_pages));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1120,10 +1563,14 @@ static ssize_t bd_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-		"%8llu %8llu %8llu\n",
+		"%8llu %8llu %8llu %8llu %8llu %8llu %8llu\n",
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)),
+			(u64)atomic64_read(&zram->stats.bd_wb_bios),
+			(u64)atomic64_read(&zram->stats.bd_wb_time),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_ra_reads)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_ra_hits)));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1148,12 +1595,38 @@ static ssize_t debug_stat_show(struct device *dev,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t dedup_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu %8zu %8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.dedup_hit),
+			(u64)atomic64_read(&zram->stats.dedup_miss),
+			(u64)atomic64_read(&zram->stats.dedup_collision),
+			zram->hash_size,
+			(u64)atomic64_read(&zram->stats.dedup_prefilter_skip),
+			(u64)atomic64_read(&zram->stats.dedup_prefilter_pass),
+			(u64)atomic64_read(&zram->stats.dedup_prefilter_false));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
 static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RO(bd_stat);
 #endif
 static DEVICE_ATTR_RO(debug_stat);
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RO(dedup_stat);
+#endif
 
 static unsigned long zram_entry_handle(struct zram *zram,
 		struct zram_entry *entry)
@@ -1200,7 +1673,8 @@ void zram_entry_free(struct zram *zram, struct zram_entry *entry)
 	if (!zram_dedup_enabled(zram))
 		return;
 
-	kfree(entry);
+	/* lockless dedup lookups may still be looking at it */
+	kfree_rcu(entry, rcu);
 
 	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
 }
@@ -1266,6 +1740,9 @@ static void zram_free_page(struct zram *zram, size_t index)
 		atomic64_dec(&zram->stats.huge_pages);
 	}
 
+	if (zram_test_flag(zram, index, ZRAM_RECOMP))
+		zram_clear_flag(zram, index, ZRAM_RECOMP);
+
 	if (zram_test_flag(zram, index, ZRAM_WB)) {
 		zram_clear_flag(zram, index, ZRAM_WB);
 		free_block_bdev(zram, zram_get_element(zram, index));
@@ -1295,7 +1772,8 @@ static void zram_free_page(struct zram *zram, size_t index)
 	zram_set_entry(zram, index, NULL);
 	zram_set_obj_size(zram, index, 0);
 	WARN_ON_ONCE(zram->table[index].flags &
-		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB));
+		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB |
+		  1UL << ZRAM_UNDER_COMP));
 }
 
 static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
@@ -1303,11 +1781,13 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 {
 	int ret;
 	struct zram_entry *entry;
+	struct zcomp *comp;
 	struct zcomp_strm *zstrm;
 	unsigned int size;
 	void *src, *dst;
 
 	zram_slot_lock(zram, index);
+	zram_wait_pending(zram, index);
 	if (zram_test_flag(zram, index, ZRAM_WB)) {
 		struct bio_vec bvec;
 
@@ -1335,9 +1815,10 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 	}
 
 	size = zram_get_obj_size(zram, index);
+	comp = zram_slot_comp(zram, index);
 
 	if (size != PAGE_SIZE)
-		zstrm = zcomp_stream_get(zram->comp);
+		zstrm = zcomp_stream_get(comp);
 
 	src = zs_map_object(zram->mem_pool,
 			    zram_entry_handle(zram, entry), ZS_MM_RO);
@@ -1350,7 +1831,7 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, entry));
 	zram_slot_unlock(zram, index);
@@ -1395,6 +1876,34 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	return ret;
 }
 
+/*
+ * Publish a freshly written page into its slot. Caller should hold the
+ * slot's bit_spinlock.
+ */
+static void zram_slot_store(struct zram *zram, u32 index,
+			struct zram_entry *entry, unsigned int comp_len,
+			enum zram_pageflags flags, unsigned long element)
+{
+	/*
+	 * Free memory associated with this sector
+	 * before overwriting unused sectors.
+	 */
+	zram_free_page(zram, index);
+
+	if (comp_len == PAGE_SIZE) {
+		zram_set_flag(zram, index, ZRAM_HUGE);
+		atomic64_inc(&zram->stats.huge_pages);
+	}
+
+	if (flags) {
+		zram_set_flag(zram, index, flags);
+		zram_set_element(zram, index, element);
+	}  else {
+		zram_set_entry(zram, index, entry);
+		zram_set_obj_size(zram, index, comp_len);
+	}
+}
+
 static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 				u32 index, struct bio *bio)
 {
@@ -1405,7 +1914,7 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	void *src, *dst, *mem;
 	struct zcomp_strm *zstrm;
 	struct page *page = bvec->bv_page;
-	u64 checksum;
+	struct zram_dedup_key key;
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
 
@@ -1419,7 +1928,7 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	}
 	kunmap_atomic(mem);
 
-	entry = zram_dedup_find(zram, page, &checksum);
+	entry = zram_dedup_find(zram, page, &key);
 	if (entry) {
 		comp_len = entry->len;
 		goto out;
@@ -1494,27 +2003,10 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	zcomp_stream_put(zram->comp);
 	zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, entry));
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
-	zram_dedup_insert(zram, entry, checksum);
+	zram_dedup_insert(zram, entry, &key);
 out:
-	/*
-	 * Free memory associated with this sector
-	 * before overwriting unused sectors.
-	 */
 	zram_slot_lock(zram, index);
-	zram_free_page(zram, index);
-
-	if (comp_len == PAGE_SIZE) {
-		zram_set_flag(zram, index, ZRAM_HUGE);
-		atomic64_inc(&zram->stats.huge_pages);
-	}
-
-	if (flags) {
-		zram_set_flag(zram, index, flags);
-		zram_set_element(zram, index, element);
-	}  else {
-		zram_set_entry(zram, index, entry);
-		zram_set_obj_size(zram, index, comp_len);
-	}
+	zram_slot_store(zram, index, entry, comp_len, flags, element);
 	zram_slot_unlock(zram, index);
 
 	/* Update stats */
@@ -1530,6 +2022,10 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	void *src;
 	struct bio_vec vec;
 
+	zram_slot_lock(zram, index);
+	zram_wait_pending(zram, index);
+	zram_slot_unlock(zram, index);
+
 	vec = *bvec;
 	if (is_partial_io(bvec)) {
 		void *dst;
@@ -1563,6 +2059,519 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define HUGE_RECOMPRESS 1
+#define IDLE_RECOMPRESS 2
+
+/*
+ * Re-encode one slot with the secondary algorithm. The new object is kept
+ * only if it is smaller than the current one. Caller should hold the slot's
+ * bit_spinlock, so nothing here may sleep; @page is a scratch page.
+ */
+static int recompress_slot(struct zram *zram, u32 index, struct page *page)
+{
+	struct zram_entry *entry, *new_entry;
+	struct zcomp_strm *zstrm;
+	unsigned int size, new_len;
+	void *src, *dst;
+	int ret = 0;
+
+	entry = zram_get_entry(zram, index);
+	size = zram_get_obj_size(zram, index);
+
+	src = zs_map_object(zram->mem_pool,
+			    zram_entry_handle(zram, entry), ZS_MM_RO);
+	dst = kmap_atomic(page);
+	if (size == PAGE_SIZE) {
+		memcpy(dst, src, PAGE_SIZE);
+	} else {
+		zstrm = zcomp_stream_get(zram->comp);
+		ret = zcomp_decompress(zstrm, src, size, dst);
+		zcomp_stream_put(zram->comp);
+	}
+	kunmap_atomic(dst);
+	zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, entry));
+	if (ret)
+		return ret;
+
+	zstrm = zcomp_stream_get(zram->recomp);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &new_len);
+	kunmap_atomic(src);
+
+	if (ret || new_len >= size || new_len >= huge_class_size)
+		goto out;
+
+	new_entry = zram_entry_alloc(zram, new_len,
+			__GFP_KSWAPD_RECLAIM |
+			__GFP_NOWARN |
+			__GFP_HIGHMEM |
+			__GFP_MOVABLE |
+			__GFP_CMA);
+	if (!new_entry) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	dst = zs_map_object(zram->mem_pool,
+			    zram_entry_handle(zram, new_entry), ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, new_len);
+	zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, new_entry));
+
+	zram_entry_free(zram, entry);
+	atomic64_sub(size, &zram->stats.compr_data_size);
+	atomic64_add(new_len, &zram->stats.compr_data_size);
+	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
+		zram_clear_flag(zram, index, ZRAM_HUGE);
+		atomic64_dec(&zram->stats.huge_pages);
+	}
+
+	zram_set_entry(zram, index, new_entry);
+	zram_set_obj_size(zram, index, new_len);
+	zram_set_flag(zram, index, ZRAM_RECOMP);
+out:
+	zcomp_stream_put(zram->recomp);
+	return ret;
+}
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long index;
+	struct page *page;
+	ssize_t ret = len;
+	int mode;
+
+	if (sysfs_streq(buf, "idle"))
+		mode = IDLE_RECOMPRESS;
+	else if (sysfs_streq(buf, "huge"))
+		mode = HUGE_RECOMPRESS;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	/* dedup matching always decompresses with the primary algorithm */
+	if (zram_dedup_enabled(zram)) {
+		ret = -EOPNOTSUPP;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	for (index = 0; index < nr_pages; index++) {
+		zram_slot_lock(zram, index);
+		if (!zram_allocated(zram, index) ||
+				!zram_get_entry(zram, index))
+			goto next;
+
+		if (zram_test_flag(zram, index, ZRAM_WB) ||
+				zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+				zram_test_flag(zram, index, ZRAM_UNDER_COMP) ||
+				zram_test_flag(zram, index, ZRAM_RECOMP))
+			goto next;
+
+		if (mode == IDLE_RECOMPRESS &&
+			  !zram_test_flag(zram, index, ZRAM_IDLE))
+			goto next;
+		if (mode == HUGE_RECOMPRESS &&
+			  !zram_test_flag(zram, index, ZRAM_HUGE))
+			goto next;
+
+		recompress_slot(zram, index, page);
+next:
+		zram_slot_unlock(zram, index);
+		cond_resched();
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static int zram_recomp_create(struct zram *zram)
+{
+	struct zcomp *comp;
+
+	if (!zram->recompressor[0])
+		return 0;
+
+	comp = zcomp_create(zram->recompressor);
+	if (IS_ERR(comp)) {
+		pr_err("Cannot initialise %s recompressing backend\n",
+				zram->recompressor);
+		return PTR_ERR(comp);
+	}
+
+	zram->recomp = comp;
+	return 0;
+}
+
+static void zram_recomp_destroy(struct zram *zram)
+{
+	if (zram->recomp)
+		zcomp_destroy(zram->recomp);
+	zram->recomp = NULL;
+}
+#else
+static inline int zram_recomp_create(struct zram *zram) { return 0; }
+static inline void zram_recomp_destroy(struct zram *zram) {}
+#endif
+
+/*
+ * Full-page writes of a multi-page bio are gathered into batches of up to
+ * ZRAM_BATCH_PAGES and compressed under a single per-cpu stream hold.
+ */
+#define ZRAM_BATCH_PAGES	8
+
+struct zram_write_ctx {
+	struct page *page;
+	struct zram_entry *entry;
+	union {
+		unsigned long element;	/* ZRAM_SAME */
+		struct zram_dedup_key key;	/* dedup key otherwise */
+	};
+	u32 index;
+	unsigned int comp_len;
+	enum zram_pageflags flags;
+};
+
+struct zram_write_batch {
+	struct zram_write_ctx ctx[ZRAM_BATCH_PAGES];
+	int nr;
+};
+
+/*
+ * Store a batch of full pages. Same-filled and duplicated pages are resolved
+ * first, then the rest are compressed and copied to their zsmalloc objects
+ * while holding one compression stream, and finally all slots are published
+ * in a single sweep. Pages whose object could not be allocated without
+ * reclaim are handed over to the regular per-page slow path.
+ */
+static int __zram_bvec_write_batch(struct zram *zram,
+				struct zram_write_ctx *ctx, int nr)
+{
+	struct zcomp_strm *zstrm = NULL;
+	unsigned long alloced_pages;
+	int i, ret = 0, published = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct zram_write_ctx *c = &ctx[i];
+		void *mem;
+
+		c->entry = NULL;
+		c->comp_len = 0;
+		c->flags = 0;
+
+		mem = kmap_atomic(c->page);
+		if (page_same_filled(mem, &c->element)) {
+			kunmap_atomic(mem);
+			c->flags = ZRAM_SAME;
+			atomic64_inc(&zram->stats.same_pages);
+			continue;
+		}
+		kunmap_atomic(mem);
+
+		c->entry = zram_dedup_find(zram, c->page, &c->key);
+		if (c->entry)
+			c->comp_len = c->entry->len;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct zram_write_ctx *c = &ctx[i];
+		struct zram_entry *entry;
+		unsigned int comp_len;
+		void *src, *dst;
+
+		if (c->flags || c->entry)
+			continue;
+
+		if (!zstrm)
+			zstrm = zcomp_stream_get(zram->comp);
+
+		src = kmap_atomic(c->page);
+		ret = zcomp_compress(zstrm, src, &comp_len);
+		kunmap_atomic(src);
+		if (unlikely(ret)) {
+			pr_err("Compression failed! err=%d\n", ret);
+			break;
+		}
+
+		if (comp_len >= huge_class_size)
+			comp_len = PAGE_SIZE;
+
+		/* Leave the page for the slow path if we would have to sleep */
+		entry = zram_entry_alloc(zram, comp_len,
+				__GFP_KSWAPD_RECLAIM |
+				__GFP_NOWARN |
+				__GFP_HIGHMEM |
+				__GFP_MOVABLE |
+				__GFP_CMA);
+		if (!entry)
+			continue;
+
+		alloced_pages = zs_get_total_pages(zram->mem_pool);
+		update_used_max(zram, alloced_pages);
+
+		if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+			zram_entry_free(zram, entry);
+			ret = -ENOMEM;
+			break;
+		}
+
+		dst = zs_map_object(zram->mem_pool,
+				    zram_entry_handle(zram, entry), ZS_MM_WO);
+
+		src = zstrm->buffer;
+		if (comp_len == PAGE_SIZE)
+			src = kmap_atomic(c->page);
+		memcpy(dst, src, comp_len);
+		if (comp_len == PAGE_SIZE)
+			kunmap_atomic(src);
+
+		zs_unmap_object(zram->mem_pool, zram_entry_handle(zram, entry));
+		atomic64_add(comp_len, &zram->stats.compr_data_size);
+		zram_dedup_insert(zram, entry, &c->key);
+
+		c->entry = entry;
+		c->comp_len = comp_len;
+	}
+
+	if (zstrm)
+		zcomp_stream_put(zram->comp);
+
+	for (i = 0; i < nr; i++) {
+		struct zram_write_ctx *c = &ctx[i];
+
+		if (!c->flags && !c->entry)
+			continue;
+
+		zram_slot_lock(zram, c->index);
+		zram_slot_store(zram, c->index, c->entry, c->comp_len,
+				c->flags, c->element);
+		zram_accessed(zram, c->index);
+		zram_slot_unlock(zram, c->index);
+		published++;
+	}
+
+	atomic64_add(published, &zram->stats.pages_stored);
+	atomic64_inc(&zram->stats.batch_writes);
+	atomic64_add(published, &zram->stats.batch_pages);
+
+	for (i = 0; i < nr && !ret; i++) {
+		struct zram_write_ctx *c = &ctx[i];
+		struct bio_vec bvec;
+
+		if (c->flags || c->entry)
+			continue;
+
+		bvec.bv_page = c->page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		ret = __zram_bvec_write(zram, &bvec, c->index, NULL);
+
+		zram_slot_lock(zram, c->index);
+		zram_accessed(zram, c->index);
+		zram_slot_unlock(zram, c->index);
+	}
+
+	return ret;
+}
+
+static int zram_write_batch_flush(struct zram *zram,
+				struct zram_write_batch *batch)
+{
+	unsigned long start_time = jiffies;
+	struct request_queue *q = zram->disk->queue;
+	int ret;
+
+	if (!batch->nr)
+		return 0;
+
+	generic_start_io_acct(q, REQ_OP_WRITE,
+			batch->nr << SECTORS_PER_PAGE_SHIFT,
+			&zram->disk->part0);
+	atomic64_add(batch->nr, &zram->stats.num_writes);
+
+	ret = __zram_bvec_write_batch(zram, batch->ctx, batch->nr);
+
+	generic_end_io_acct(q, REQ_OP_WRITE, &zram->disk->part0, start_time);
+	if (unlikely(ret < 0))
+		atomic64_inc(&zram->stats.failed_writes);
+
+	batch->nr = 0;
+	return ret;
+}
+
+struct zram_comp_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct bio *bio;	/* NULL for a single page from ->rw_page */
+	struct zram_write_batch batch;
+};
+
+/* Minimum number of work items kept around for writes from reclaim */
+#define ZRAM_COMP_WORK_MIN	(2 * ZRAM_BATCH_PAGES)
+
+static void zram_comp_work_fn(struct work_struct *work)
+{
+	struct zram_comp_work *zw = container_of(work, struct zram_comp_work,
+						 work);
+	struct zram *zram = zw->zram;
+	int i, nr = zw->batch.nr;
+	int ret;
+
+	ret = zram_write_batch_flush(zram, &zw->batch);
+
+	for (i = 0; i < nr; i++) {
+		u32 index = zw->batch.ctx[i].index;
+
+		zram_slot_lock(zram, index);
+		zram_clear_flag(zram, index, ZRAM_UNDER_COMP);
+		zram_slot_unlock(zram, index);
+	}
+	wake_up_all(&zram->comp_wait);
+
+	if (zw->bio) {
+		if (unlikely(ret < 0))
+			zw->bio->bi_status = BLK_STS_IOERR;
+		bio_endio(zw->bio);
+	} else {
+		struct page *page = zw->batch.ctx[0].page;
+
+		/*
+		 * ->rw_page has already returned, so the caller can't resubmit
+		 * through a bio. Keep the data the way a failed bio write
+		 * would: redirty the page before ending writeback.
+		 */
+		if (unlikely(ret < 0)) {
+			SetPageError(page);
+			set_page_dirty(page);
+			ClearPageReclaim(page);
+		}
+		end_page_writeback(page);
+		put_page(page);
+	}
+
+	mempool_free(zw, zram->comp_work_pool);
+}
+
+/*
+ * Hand a batch over to the compression workers. The pages stay pinned
+ * (by the bio or by an extra reference for ->rw_page) until their objects
+ * are published, and the slots are marked ZRAM_UNDER_COMP so that readers
+ * and later writers wait for the publication. Returns false if the device
+ * is not in async mode or no work item is available without blocking, in
+ * which case the caller compresses synchronously.
+ */
+static bool zram_write_batch_queue(struct zram *zram,
+				struct zram_write_batch *batch, struct bio *bio)
+{
+	struct zram_comp_work *zw;
+	int i;
+
+	if (!zram->comp_wq)
+		return false;
+
+	zw = mempool_alloc(zram->comp_work_pool, GFP_NOWAIT | __GFP_NOWARN);
+	if (!zw)
+		return false;
+
+	for (i = 0; i < batch->nr; i++) {
+		u32 index = batch->ctx[i].index;
+
+		zram_slot_lock(zram, index);
+		zram_wait_pending(zram, index);
+		zram_set_flag(zram, index, ZRAM_UNDER_COMP);
+		zram_slot_unlock(zram, index);
+
+		if (!bio)
+			get_page(batch->ctx[i].page);
+	}
+
+	INIT_WORK(&zw->work, zram_comp_work_fn);
+	zw->zram = zram;
+	zw->bio = bio;
+	zw->batch = *batch;
+	if (bio)
+		bio_inc_remaining(bio);
+	queue_work(zram->comp_wq, &zw->work);
+
+	batch->nr = 0;
+	return true;
+}
+
+static int zram_write_batch_submit(struct zram *zram,
+				struct zram_write_batch *batch, struct bio *bio)
+{
+	int i;
+
+	if (!batch->nr || zram_write_batch_queue(zram, batch, bio))
+		return 0;
+
+	if (zram->comp_wq) {
+		for (i = 0; i < batch->nr; i++) {
+			u32 index = batch->ctx[i].index;
+
+			zram_slot_lock(zram, index);
+			zram_wait_pending(zram, index);
+			zram_slot_unlock(zram, index);
+		}
+	}
+
+	return zram_write_batch_flush(zram, batch);
+}
+
+static int zram_comp_init(struct zram *zram)
+{
+	if (!zram->async_comp)
+		return 0;
+
+	zram->comp_work_pool = mempool_create_kmalloc_pool(ZRAM_COMP_WORK_MIN,
+					sizeof(struct zram_comp_work));
+	if (!zram->comp_work_pool)
+		return -ENOMEM;
+
+	/*
+	 * Unbound workers let the scheduler spread compression over idle
+	 * cores instead of the reclaiming one. WQ_MEM_RECLAIM because we
+	 * sit on the swap-out path.
+	 */
+	zram->comp_wq = alloc_workqueue("%s_comp", WQ_UNBOUND | WQ_MEM_RECLAIM,
+					0, zram->disk->disk_name);
+	if (!zram->comp_wq) {
+		mempool_destroy(zram->comp_work_pool);
+		zram->comp_work_pool = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void zram_comp_fini(struct zram *zram)
+{
+	if (zram->comp_wq) {
+		/* drains all queued writes */
+		destroy_workqueue(zram->comp_wq);
+		zram->comp_wq = NULL;
+	}
+	mempool_destroy(zram->comp_work_pool);
+	zram->comp_work_pool = NULL;
+}
+
 /*
  * zram_bio_discard - handler on discard request
  * @index: physical block index in PAGE_SIZE units
@@ -1593,6 +2602,7 @@ static void zram_bio_discard(struct zram *zram, u32 index,
 
 	while (n >= PAGE_SIZE) {
 		zram_slot_lock(zram, index);
+		zram_wait_pending(zram, index);
 		zram_free_page(zram, index);
 		zram_slot_unlock(zram, index);
 		atomic64_inc(&zram->stats.notify_free);
@@ -1648,6 +2658,8 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 	u32 index;
 	struct bio_vec bvec;
 	struct bvec_iter iter;
+	struct zram_write_batch batch;
+	bool is_write = op_is_write(bio_op(bio));
 
 	index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = (bio->bi_iter.bi_sector &
@@ -1663,15 +2675,30 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		break;
 	}
 
+	batch.nr = 0;
 	bio_for_each_segment(bvec, bio, iter) {
 		struct bio_vec bv = bvec;
 		unsigned int unwritten = bvec.bv_len;
 
+		if (is_write && !offset && bvec.bv_len == PAGE_SIZE) {
+			struct zram_write_ctx *c = &batch.ctx[batch.nr++];
+
+			c->page = bvec.bv_page;
+			c->index = index++;
+			if (batch.nr == ZRAM_BATCH_PAGES &&
+			    zram_write_batch_submit(zram, &batch, bio) < 0)
+				goto out;
+			continue;
+		}
+
+		if (zram_write_batch_submit(zram, &batch, bio) < 0)
+			goto out;
+
 		do {
 			bv.bv_len = min_t(unsigned int, PAGE_SIZE - offset,
 							unwritten);
 			if (zram_bvec_rw(zram, &bv, index, offset,
-					op_is_write(bio_op(bio)), bio) < 0)
+					is_write, bio) < 0)
 				goto out;
 
 			bv.bv_offset += bv.bv_len;
@@ -1681,6 +2708,9 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		} while (unwritten);
 	}
 
+	if (zram_write_batch_submit(zram, &batch, bio) < 0)
+		goto out;
+
 	bio_endio(bio);
 	return;
 
@@ -1722,6 +2752,13 @@ static void zram_slot_free_notify(struct block_device *bdev,
 		return;
 	}
 
+	/* We can't wait for a queued write from here */
+	if (zram_test_flag(zram, index, ZRAM_UNDER_COMP)) {
+		zram_slot_unlock(zram, index);
+		atomic64_inc(&zram->stats.miss_free);
+		return;
+	}
+
 	zram_free_page(zram, index);
 	zram_slot_unlock(zram, index);
 }
@@ -1747,6 +2784,16 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	index = sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = (sector & (SECTORS_PER_PAGE - 1)) << SECTOR_SHIFT;
 
+	if (is_write && !offset && zram->comp_wq) {
+		struct zram_write_batch batch;
+
+		batch.ctx[0].page = page;
+		batch.ctx[0].index = index;
+		batch.nr = 1;
+		if (zram_write_batch_queue(zram, &batch, NULL))
+			return 0;
+	}
+
 	bv.bv_page = page;
 	bv.bv_len = PAGE_SIZE;
 	bv.bv_offset = 0;
@@ -1760,6 +2807,8 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	 * of rw_page(e.g., swap_readpage, __swap_writepage) and
 	 * bio->bi_end_io does things to handle the error
 	 * (e.g., SetPageError, set_page_dirty and extra works).
+	 * Queued writes can't be resubmitted, so zram_comp_work_fn() does
+	 * that error handling itself.
 	 */
 	if (unlikely(ret < 0))
 		return ret;
@@ -1799,10 +2848,12 @@ static void zram_reset_device(struct zram *zram)
 	part_stat_set_all(&zram->disk->part0, 0);
 
 	up_write(&zram->init_lock);
+	zram_comp_fini(zram);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
+	zram_recomp_destroy(zram);
 	reset_bdev(zram);
 }
 
@@ -1837,6 +2888,19 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+	err = zram_recomp_create(zram);
+	if (err) {
+		zcomp_destroy(comp);
+		goto out_free_meta;
+	}
+
+	err = zram_comp_init(zram);
+	if (err) {
+		zram_recomp_destroy(zram);
+		zcomp_destroy(comp);
+		goto out_free_meta;
+	}
+
 	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
@@ -1928,7 +2992,12 @@ static DEVICE_ATTR_WO(mem_limit);
 static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(max_comp_streams);
+static DEVICE_ATTR_RW(async_comp);
 static DEVICE_ATTR_RW(comp_algorithm);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 static DEVICE_ATTR_WO(writeback);
@@ -1950,7 +3019,12 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_idle.attr,
 	&dev_attr_max_comp_streams.attr,
+	&dev_attr_async_comp.attr,
 	&dev_attr_comp_algorithm.attr,
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 	&dev_attr_writeback.attr,
@@ -1964,6 +3038,9 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_bd_stat.attr,
 #endif
 	&dev_attr_debug_stat.attr,
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_dedup_stat.attr,
+#endif
 	NULL,
 };
 
@@ -1996,8 +3073,12 @@ static int zram_add(void)
 	device_id = ret;
 
 	init_rwsem(&zram->init_lock);
+	init_waitqueue_head(&zram->comp_wait);
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spin_lock_init(&zram->wb_limit_lock);
+	spin_lock_init(&zram->ra_lock);
+	atomic_set(&zram->ra_inflight, 0);
+	init_waitqueue_head(&zram->ra_wait);
 #endif
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
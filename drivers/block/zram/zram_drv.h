@@ -19,6 +19,8 @@
 #include <linux/zsmalloc.h>
 #include <linux/crypto.h>
 #include <linux/spinlock.h>
+#include <linux/mempool.h>
+#include <linux/workqueue.h>
 
 #include "zcomp.h"
 #include "zram_dedup.h"
@@ -51,6 +53,8 @@ enum zram_pageflags {
 	ZRAM_UNDER_WB,	/* page is under writeback */
 	ZRAM_HUGE,	/* Incompressible page */
 	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_UNDER_COMP,	/* page is queued for async compression */
+	ZRAM_RECOMP,	/* page is compressed with the secondary algorithm */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -58,10 +62,12 @@ enum zram_pageflags {
 /*-- Data structures */
 
 struct zram_entry {
-	struct rb_node rb_node;
+	struct hlist_node node;
+	struct rcu_head rcu;
 	u32 len;
+	u64 fingerprint;
 	u64 checksum;
-	unsigned long refcount;
+	atomic_long_t refcount;
 	unsigned long handle;
 };
 
@@ -77,6 +83,14 @@ struct zram_table_entry {
 #endif
 };
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+struct zram_ra_entry {
+	unsigned long blk_idx;	/* 0 if invalidated while pending */
+	struct page *page;
+	int state;
+};
+#endif
+
 struct zram_stats {
 	atomic64_t compr_data_size;	/* compressed size of pages stored */
 	atomic64_t num_reads;	/* failed + successful */
@@ -95,17 +109,36 @@ struct zram_stats {
 					 * duplicated
 					 */
 	atomic64_t meta_data_size;	/* size of zram_entries */
+	atomic64_t dedup_hit;		/* no. of dedup lookup hits */
+	atomic64_t dedup_miss;		/* no. of dedup lookup misses */
+	atomic64_t dedup_collision;	/*
+					 * no. of bucket entries skipped for a
+					 * different fingerprint or checksum
+					 */
+	atomic64_t dedup_prefilter_skip; /* lookups rejected by the bloom */
+	atomic64_t dedup_prefilter_pass; /* lookups needing a full hash */
+	atomic64_t dedup_prefilter_false; /* passes without a duplicate */
 	atomic64_t miss_free;		/* no. of missed free */
+	atomic64_t batch_writes;	/* no. of batched write flushes */
+	atomic64_t batch_pages;		/* no. of pages stored by batches */
 #ifdef	CONFIG_ZRAM_WRITEBACK
 	atomic64_t bd_count;		/* no. of pages in backing device */
 	atomic64_t bd_reads;		/* no. of reads from backing device */
 	atomic64_t bd_writes;		/* no. of writes from backing device */
+	atomic64_t bd_wb_bios;		/* no. of writeback bios submitted */
+	atomic64_t bd_wb_time;		/* msecs spent in writeback */
+	atomic64_t bd_ra_reads;		/* no. of pages read ahead */
+	atomic64_t bd_ra_hits;		/* no. of reads served by readahead */
 #endif
 };
 
+/*
+ * Lookups walk the chain under RCU and only take a reference on a matching
+ * entry; the lock serializes insertion and removal.
+ */
 struct zram_hash {
 	spinlock_t lock;
-	struct rb_root rb_root;
+	struct hlist_head head;
 };
 
 struct zram {
@@ -115,6 +148,12 @@ struct zram {
 	struct gendisk *disk;
 	struct zram_hash *hash;
 	size_t hash_size;
+	/* dedup bloom prefilter over entry fingerprints */
+	unsigned long __rcu *bloom;
+	unsigned long __rcu *bloom_next;	/* set while rebuilding */
+	unsigned int bloom_shift;
+	atomic_long_t bloom_inserts;
+	struct work_struct bloom_work;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
 	/*
@@ -129,11 +168,21 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[CRYPTO_MAX_ALG_NAME];
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	struct zcomp *recomp;
+	char recompressor[CRYPTO_MAX_ALG_NAME];
+#endif
 	/*
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
 	bool use_dedup;
+	bool async_comp;
+	/* compression offload workers, only when async_comp is set */
+	struct workqueue_struct *comp_wq;
+	mempool_t *comp_work_pool;
+	/* woken when queued writes clear ZRAM_UNDER_COMP */
+	wait_queue_head_t comp_wait;
 	struct file *backing_dev;
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spinlock_t wb_limit_lock;
@@ -143,6 +192,11 @@ struct zram {
 	unsigned int old_block_size;
 	unsigned long *bitmap;
 	unsigned long nr_pages;
+	/* readahead cache of written back pages */
+	spinlock_t ra_lock;
+	struct zram_ra_entry *ra_cache;
+	atomic_t ra_inflight;
+	wait_queue_head_t ra_wait;
 #endif
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
@@ -5,7 +5,9 @@
  * Copyright (C) 2019-2021 Sultan Alsawaf <sultan@kerneltoast.com>.
  */
 
+#include <linux/debugfs.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include "ion_secure_util.h"
@@ -16,9 +18,20 @@ struct ion_dma_buf_attachment {
 	struct device *dev;
 	struct sg_table table;
 	struct list_head list;
+	enum dma_data_direction dir;
+	unsigned long map_attrs;
 	bool dma_mapped;
+	/* Still mapped for the device after unmap, for reuse by the next map */
+	bool dma_cached;
 };
 
+static void ion_dma_unmap_cached(struct ion_dma_buf_attachment *a)
+{
+	dma_unmap_sg_attrs(a->dev, a->table.sgl, a->table.nents, a->dir,
+			   a->map_attrs | DMA_ATTR_SKIP_CPU_SYNC);
+	a->dma_cached = false;
+}
+
 static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 static const struct file_operations ion_fops = {
 	.unlocked_ioctl = ion_ioctl,
@@ -43,12 +56,15 @@ static void ion_buffer_free_work(struct work_struct *work)
 	msm_dma_buf_freed(&buffer->iommu_data);
 	for (a = buffer->attachments; a; a = next) {
 		next = a->next;
+		if (a->dma_cached)
+			ion_dma_unmap_cached(a);
 		sg_free_table(&a->table);
 		kfree(a);
 	}
 	if (buffer->kmap_refcount)
 		heap->ops->unmap_kernel(heap, buffer);
 	heap->ops->free(buffer);
+	kvfree(buffer->dirty_map);
 	kfree(buffer);
 }
 
@@ -70,6 +86,9 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap, size_t len,
 		.free = __WORK_INITIALIZER(buffer->free, ion_buffer_free_work),
 		.map_freelist = LIST_HEAD_INIT(buffer->map_freelist),
 		.freelist_lock = __SPIN_LOCK_UNLOCKED(buffer->freelist_lock),
+		.vmas = LIST_HEAD_INIT(buffer->vmas),
+		.vma_lock = __MUTEX_INITIALIZER(buffer->vma_lock),
+		.cpu_access = ATOMIC_INIT(0),
 		.iommu_data = {
 			.map_list = LIST_HEAD_INIT(buffer->iommu_data.map_list),
 			.lock = __MUTEX_INITIALIZER(buffer->iommu_data.lock)
@@ -86,6 +105,17 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap, size_t len,
 			goto free_buffer;
 	}
 
+	/*
+	 * Cached buffers track which pages the CPU may have dirtied so that
+	 * ending CPU access only has to clean those. Without the map, every
+	 * sync covers the whole buffer. Heaps may clear ION_FLAG_CACHED in
+	 * ->allocate, so check the buffer's flags.
+	 */
+	if (buffer->flags & ION_FLAG_CACHED)
+		buffer->dirty_map = kvzalloc(BITS_TO_LONGS(PAGE_ALIGN(len) >>
+							   PAGE_SHIFT) *
+					     sizeof(long), GFP_KERNEL);
+
 	return buffer;
 
 free_buffer:
@@ -93,6 +123,49 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap, size_t len,
 	return ERR_PTR(ret);
 }
 
+/*
+ * Unmap [offset, offset + len) of the buffer from every tracked user mapping,
+ * so that the next CPU write to it faults and is recorded in the dirty map
+ * again. Must be done before the range's dirty bits are cleared.
+ */
+static void ion_buffer_zap_user(struct ion_buffer *buffer,
+				unsigned long offset, unsigned long len)
+{
+	struct ion_vma_list *vma_list;
+
+	mutex_lock(&buffer->vma_lock);
+	list_for_each_entry(vma_list, &buffer->vmas, list) {
+		struct vm_area_struct *vma = vma_list->vma;
+		unsigned long start = vma->vm_pgoff << PAGE_SHIFT;
+		unsigned long end = start + vma->vm_end - vma->vm_start;
+		unsigned long lo = max(start, round_down(offset, PAGE_SIZE));
+		unsigned long hi = min(end, PAGE_ALIGN(offset + len));
+
+		if (lo < hi)
+			zap_vma_ptes(vma, vma->vm_start + lo - start, hi - lo);
+	}
+	mutex_unlock(&buffer->vma_lock);
+}
+
+/* Forget dirty pages that lie entirely within [offset, offset + len) */
+static void ion_buffer_clear_dirty(struct ion_buffer *buffer,
+				   unsigned long offset, unsigned long len)
+{
+	unsigned long first, end;
+
+	if (!buffer->dirty_map)
+		return;
+
+	first = DIV_ROUND_UP(offset, PAGE_SIZE);
+	if (offset + len >= buffer->size)
+		end = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+	else
+		end = (offset + len) >> PAGE_SHIFT;
+	for (first = find_next_bit(buffer->dirty_map, end, first); first < end;
+	     first = find_next_bit(buffer->dirty_map, end, first + 1))
+		clear_bit(first, buffer->dirty_map);
+}
+
 static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 					enum dma_data_direction dir)
 {
@@ -106,6 +179,20 @@ static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 	    !hlos_accessible_buffer(buffer))
 		map_attrs |= DMA_ATTR_SKIP_CPU_SYNC;
 
+	/* Reuse the mapping kept by the last unmap if it's compatible */
+	if (a->dma_cached) {
+		if (a->dir == dir && a->map_attrs == map_attrs) {
+			if (!(map_attrs & DMA_ATTR_SKIP_CPU_SYNC))
+				dma_sync_sg_for_device(attachment->dev,
+						       a->table.sgl,
+						       a->table.nents, dir);
+			a->dma_cached = false;
+			a->dma_mapped = true;
+			return &a->table;
+		}
+		ion_dma_unmap_cached(a);
+	}
+
 	if (map_attrs & DMA_ATTR_DELAYED_UNMAP)
 		count = msm_dma_map_sg_attrs(attachment->dev, a->table.sgl,
 					     a->table.nents, dir, dmabuf,
@@ -116,6 +203,8 @@ static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 	if (!count)
 		return ERR_PTR(-ENOMEM);
 
+	a->dir = dir;
+	a->map_attrs = map_attrs;
 	a->dma_mapped = true;
 	return &a->table;
 }
@@ -134,15 +223,114 @@ static void ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
 	    !hlos_accessible_buffer(buffer))
 		map_attrs |= DMA_ATTR_SKIP_CPU_SYNC;
 
-	if (map_attrs & DMA_ATTR_DELAYED_UNMAP)
+	if (map_attrs & DMA_ATTR_DELAYED_UNMAP) {
 		msm_dma_unmap_sg_attrs(attachment->dev, table->sgl,
 				       table->nents, dir, dmabuf, map_attrs);
-	else
-		dma_unmap_sg_attrs(attachment->dev, table->sgl, table->nents,
-				   dir, map_attrs);
+	} else {
+		/*
+		 * Keep the IOMMU mapping around until the buffer is freed so
+		 * that the next map from this device only needs cache
+		 * maintenance. Hand the buffer back to the CPU like a real
+		 * unmap would.
+		 */
+		if (!(map_attrs & DMA_ATTR_SKIP_CPU_SYNC))
+			dma_sync_sg_for_cpu(attachment->dev, table->sgl,
+					    table->nents, dir);
+		a->dma_cached = true;
+	}
 	a->dma_mapped = false;
 }
 
+static struct page *ion_buffer_page(struct ion_buffer *buffer, pgoff_t pgoff)
+{
+	struct sg_table *table = buffer->sg_table;
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		unsigned long n = sg->length >> PAGE_SHIFT;
+
+		if (pgoff < n)
+			return nth_page(sg_page(sg), pgoff);
+		pgoff -= n;
+	}
+
+	return NULL;
+}
+
+static void ion_vm_open(struct vm_area_struct *vma)
+{
+	struct ion_buffer *buffer = vma->vm_private_data;
+	struct ion_vma_list *vma_list;
+
+	vma_list = kmalloc(sizeof(*vma_list), GFP_KERNEL);
+	if (!vma_list) {
+		/* Its ptes can't be zapped, so writes through it go unseen */
+		WRITE_ONCE(buffer->mmap_untracked, true);
+		return;
+	}
+
+	vma_list->vma = vma;
+	mutex_lock(&buffer->vma_lock);
+	list_add(&vma_list->list, &buffer->vmas);
+	mutex_unlock(&buffer->vma_lock);
+}
+
+static void ion_vm_close(struct vm_area_struct *vma)
+{
+	struct ion_buffer *buffer = vma->vm_private_data;
+	struct ion_vma_list *vma_list;
+
+	mutex_lock(&buffer->vma_lock);
+	list_for_each_entry(vma_list, &buffer->vmas, list) {
+		if (vma_list->vma == vma) {
+			list_del(&vma_list->list);
+			kfree(vma_list);
+			break;
+		}
+	}
+	mutex_unlock(&buffer->vma_lock);
+}
+
+/*
+ * Pages are mapped in on demand. The core mm keeps them read-only because of
+ * ->pfn_mkwrite, so the first write to each page after a sync for the device
+ * faults again and is recorded.
+ */
+static int ion_vm_fault(struct vm_fault *vmf)
+{
+	struct ion_buffer *buffer = vmf->vma->vm_private_data;
+	struct page *page;
+	int ret;
+
+	page = ion_buffer_page(buffer, vmf->pgoff);
+	if (!page)
+		return VM_FAULT_SIGBUS;
+
+	ret = vm_insert_pfn(vmf->vma, vmf->address, page_to_pfn(page));
+	if (ret == -ENOMEM)
+		return VM_FAULT_OOM;
+	if (ret && ret != -EBUSY)
+		return VM_FAULT_SIGBUS;
+
+	return VM_FAULT_NOPAGE;
+}
+
+static int ion_vm_pfn_mkwrite(struct vm_fault *vmf)
+{
+	struct ion_buffer *buffer = vmf->vma->vm_private_data;
+
+	set_bit(vmf->pgoff, buffer->dirty_map);
+	return 0;
+}
+
+static const struct vm_operations_struct ion_vma_ops = {
+	.open = ion_vm_open,
+	.close = ion_vm_close,
+	.fault = ion_vm_fault,
+	.pfn_mkwrite = ion_vm_pfn_mkwrite,
+};
+
 static int ion_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 {
 	struct ion_buffer *buffer = container_of(dmabuf->priv, typeof(*buffer),
@@ -155,6 +343,23 @@ static int ion_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 	if (!(buffer->flags & ION_FLAG_CACHED))
 		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
 
+	/*
+	 * Shared mappings of buffers with a dirty map are faulted in so that
+	 * CPU writes through them can be tracked. Private mappings never write
+	 * to the buffer itself. Heaps with their own ->map_user may refuse
+	 * the mapping, so leave those to it.
+	 */
+	if (buffer->dirty_map && (vma->vm_flags & VM_SHARED) &&
+	    heap->ops->map_user == ion_heap_map_user &&
+	    hlos_accessible_buffer(buffer)) {
+		vma->vm_flags |= VM_PFNMAP | VM_IO | VM_DONTEXPAND |
+				 VM_DONTDUMP;
+		vma->vm_private_data = buffer;
+		vma->vm_ops = &ion_vma_ops;
+		ion_vm_open(vma);
+		return 0;
+	}
+
 	return heap->ops->map_user(heap, buffer, vma);
 }
 
@@ -181,6 +386,8 @@ static void *ion_dma_buf_vmap(struct dma_buf *dmabuf)
 		return ERR_PTR(-ENODEV);
 
 	mutex_lock(&buffer->kmap_lock);
+	/* Kernel mappings can write anywhere at any time */
+	WRITE_ONCE(buffer->dirty_all, true);
 	if (buffer->kmap_refcount) {
 		vaddr = buffer->vaddr;
 		buffer->kmap_refcount++;
@@ -227,22 +434,53 @@ static void ion_dma_buf_kunmap(struct dma_buf *dmabuf, unsigned long offset,
 	ion_dma_buf_vunmap(dmabuf, NULL);
 }
 
-static int ion_dup_sg_table(struct sg_table *dst, struct sg_table *src)
+/*
+ * Whether @add bytes can be merged into a @len byte segment. Heap chunks can
+ * already be larger than the device's max_seg, in which case they are copied
+ * as they are and never merged with.
+ */
+static bool ion_sg_can_merge(unsigned int len, unsigned int add,
+			     unsigned int max_seg)
+{
+	return (u64)len + add <= max_seg;
+}
+
+/*
+ * Copy an sg table for an attachment, merging physically contiguous entries
+ * up to the device's maximum segment size. Heaps emit one entry per allocated
+ * chunk, so this cuts down the work of every dma_map_sg() of the copy.
+ */
+static int ion_dup_sg_table(struct sg_table *dst, struct sg_table *src,
+			    unsigned int max_seg)
 {
-	unsigned int nents = src->nents;
-	struct scatterlist *d, *s;
+	unsigned int i, run = 0, nents = 0;
+	struct scatterlist *s, *d = NULL;
+	phys_addr_t end = 0;
+
+	for_each_sg(src->sgl, s, src->nents, i) {
+		if (!nents || sg_phys(s) != end ||
+		    !ion_sg_can_merge(run, s->length, max_seg)) {
+			nents++;
+			run = 0;
+		}
+		run += s->length;
+		end = sg_phys(s) + s->length;
+	}
 
 	if (sg_alloc_table(dst, nents, GFP_KERNEL))
 		return -ENOMEM;
 
-	for (d = dst->sgl, s = src->sgl;
-	     nents > SG_MAX_SINGLE_ALLOC; nents -= SG_MAX_SINGLE_ALLOC - 1,
-	     d = sg_chain_ptr(&d[SG_MAX_SINGLE_ALLOC - 1]),
-	     s = sg_chain_ptr(&s[SG_MAX_SINGLE_ALLOC - 1]))
-		memcpy(d, s, (SG_MAX_SINGLE_ALLOC - 1) * sizeof(*d));
-
-	if (nents)
-		memcpy(d, s, nents * sizeof(*d));
+	for_each_sg(src->sgl, s, src->nents, i) {
+		if (d && sg_phys(s) == end &&
+		    ion_sg_can_merge(d->length, s->length, max_seg)) {
+			d->length += s->length;
+		} else {
+			d = d ? sg_next(d) : dst->sgl;
+			sg_set_page(d, sg_page(s), s->length, s->offset);
+			sg_dma_address(d) = sg_phys(d);
+		}
+		end = sg_phys(s) + s->length;
+	}
 
 	return 0;
 }
@@ -269,13 +507,15 @@ static int ion_dma_buf_attach(struct dma_buf *dmabuf, struct device *dev,
 	if (!a)
 		return -ENOMEM;
 
-	if (ion_dup_sg_table(&a->table, buffer->sg_table)) {
+	if (ion_dup_sg_table(&a->table, buffer->sg_table,
+			     dma_get_max_seg_size(dev))) {
 		kfree(a);
 		return -ENOMEM;
 	}
 
 	a->dev = dev;
 	a->dma_mapped = false;
+	a->dma_cached = false;
 	attachment->priv = a;
 	a->next = buffer->attachments;
 	buffer->attachments = a;
@@ -295,6 +535,49 @@ static void ion_dma_buf_detach(struct dma_buf *dmabuf,
 	spin_unlock(&buffer->freelist_lock);
 }
 
+static void ion_sgl_sync_range(struct device *dev, struct scatterlist *sgl,
+			       unsigned int nents, unsigned long offset,
+			       unsigned long len, enum dma_data_direction dir,
+			       bool for_cpu)
+{
+	dma_addr_t sg_dma_addr = sg_dma_address(sgl);
+	unsigned long total = 0;
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(sgl, sg, nents, i) {
+		unsigned long sg_offset, sg_left, size;
+
+		total += sg->length;
+		if (total <= offset) {
+			sg_dma_addr += sg->length;
+			continue;
+		}
+
+		sg_left = total - offset;
+		sg_offset = sg->length - sg_left;
+		size = min(len, sg_left);
+		if (for_cpu)
+			dma_sync_single_range_for_cpu(dev, sg_dma_addr,
+						      sg_offset, size, dir);
+		else
+			dma_sync_single_range_for_device(dev, sg_dma_addr,
+							 sg_offset, size, dir);
+		len -= size;
+		if (!len)
+			break;
+
+		offset += size;
+		sg_dma_addr += sg->length;
+	}
+}
+
+/* Partial syncs need the whole buffer to be mapped contiguously */
+static bool ion_attachment_contig(struct ion_dma_buf_attachment *a)
+{
+	return a->table.nents <= 1 || !sg_next(a->table.sgl)->dma_length;
+}
+
 static int ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 					enum dma_data_direction dir)
 {
@@ -308,6 +591,12 @@ static int ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 	if (!(buffer->flags & ION_FLAG_CACHED))
 		return 0;
 
+	/*
+	 * CPU writes are recorded where they happen: user mapping faults set
+	 * dirty map bits and kernel mappings set dirty_all.
+	 */
+	atomic_inc(&buffer->cpu_access);
+
 	for (a = buffer->attachments; a; a = a->next) {
 		if (a->dma_mapped)
 			dma_sync_sg_for_cpu(a->dev, a->table.sgl,
@@ -323,6 +612,9 @@ static int ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 	struct ion_buffer *buffer = container_of(dmabuf->priv, typeof(*buffer),
 						 iommu_data);
 	struct ion_dma_buf_attachment *a;
+	unsigned long npages, start, end, i;
+	bool full, clear;
+	int open;
 
 	if (!hlos_accessible_buffer(buffer))
 		return -EPERM;
@@ -330,8 +622,62 @@ static int ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 	if (!(buffer->flags & ION_FLAG_CACHED))
 		return 0;
 
+	/*
+	 * An end without a matching begin gets a full clean, as it did before
+	 * dirty tracking. The dirty state is only reset by the last bracket
+	 * to close, and only for directions that hand CPU writes to the
+	 * device; otherwise a still open bracket would lose its writes.
+	 */
+	open = atomic_dec_if_positive(&buffer->cpu_access);
+	clear = dir != DMA_FROM_DEVICE && open <= 0;
+	full = !buffer->dirty_map || dir == DMA_FROM_DEVICE || open < 0 ||
+	       READ_ONCE(buffer->dirty_all) ||
+	       READ_ONCE(buffer->kmap_refcount) ||
+	       READ_ONCE(buffer->mmap_untracked);
+
+	if (clear && buffer->dirty_map && !READ_ONCE(buffer->kmap_refcount))
+		WRITE_ONCE(buffer->dirty_all, false);
+
+	/*
+	 * Only pages with a dirty bit can be writable in a user mapping, so
+	 * only those runs are zapped. That happens before their bits are
+	 * cleared and the runs are synced afterwards, so a write racing with
+	 * the clean either gets cleaned or faults and stays dirty.
+	 */
+	if (buffer->dirty_map && (clear || !full)) {
+		npages = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+		for (start = find_first_bit(buffer->dirty_map, npages);
+		     start < npages;
+		     start = find_next_bit(buffer->dirty_map, npages, end)) {
+			end = find_next_zero_bit(buffer->dirty_map, npages,
+						 start);
+			if (clear) {
+				ion_buffer_zap_user(buffer, start << PAGE_SHIFT,
+						    (end - start) << PAGE_SHIFT);
+				for (i = start; i < end; i++)
+					clear_bit(i, buffer->dirty_map);
+			}
+			if (full)
+				continue;
+
+			/* Clean only what the CPU may have written */
+			for (a = buffer->attachments; a; a = a->next) {
+				if (!a->dma_mapped || !ion_attachment_contig(a))
+					continue;
+				ion_sgl_sync_range(a->dev, a->table.sgl,
+						   a->table.nents,
+						   start << PAGE_SHIFT,
+						   min_t(unsigned long,
+							 end << PAGE_SHIFT,
+							 buffer->size) -
+						   (start << PAGE_SHIFT),
+						   dir, false);
+			}
+		}
+	}
+
 	for (a = buffer->attachments; a; a = a->next) {
-		if (a->dma_mapped)
+		if (a->dma_mapped && (full || !ion_attachment_contig(a)))
 			dma_sync_sg_for_device(a->dev, a->table.sgl,
 					       a->table.nents, dir);
 	}
@@ -339,43 +685,6 @@ static int ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 	return 0;
 }
 
-static void ion_sgl_sync_range(struct device *dev, struct scatterlist *sgl,
-			       unsigned int nents, unsigned long offset,
-			       unsigned long len, enum dma_data_direction dir,
-			       bool for_cpu)
-{
-	dma_addr_t sg_dma_addr = sg_dma_address(sgl);
-	unsigned long total = 0;
-	struct scatterlist *sg;
-	int i;
-
-	for_each_sg(sgl, sg, nents, i) {
-		unsigned long sg_offset, sg_left, size;
-
-		total += sg->length;
-		if (total <= offset) {
-			sg_dma_addr += sg->length;
-			continue;
-		}
-
-		sg_left = total - offset;
-		sg_offset = sg->length - sg_left;
-		size = min(len, sg_left);
-		if (for_cpu)
-			dma_sync_single_range_for_cpu(dev, sg_dma_addr,
-						      sg_offset, size, dir);
-		else
-			dma_sync_single_range_for_device(dev, sg_dma_addr,
-							 sg_offset, size, dir);
-		len -= size;
-		if (!len)
-			break;
-
-		offset += size;
-		sg_dma_addr += sg->length;
-	}
-}
-
 static int ion_dma_buf_cpu_access_partial(struct dma_buf *dmabuf,
 					  enum dma_data_direction dir,
 					  unsigned int offset, unsigned int len,
@@ -384,6 +693,7 @@ static int ion_dma_buf_cpu_access_partial(struct dma_buf *dmabuf,
 	struct ion_buffer *buffer = container_of(dmabuf->priv, typeof(*buffer),
 						 iommu_data);
 	struct ion_dma_buf_attachment *a;
+	int open = 0;
 	int ret = 0;
 
 	if (!hlos_accessible_buffer(buffer))
@@ -392,17 +702,30 @@ static int ion_dma_buf_cpu_access_partial(struct dma_buf *dmabuf,
 	if (!(buffer->flags & ION_FLAG_CACHED))
 		return 0;
 
-	for (a = buffer->attachments; a; a = a->next) {
-		if (!a->dma_mapped)
-			continue;
+	if (start)
+		atomic_inc(&buffer->cpu_access);
+	else
+		open = atomic_dec_if_positive(&buffer->cpu_access);
 
-		if (a->table.nents > 1 && sg_next(a->table.sgl)->dma_length) {
+	for (a = buffer->attachments; a; a = a->next) {
+		if (a->dma_mapped && !ion_attachment_contig(a))
 			ret = -EINVAL;
-			continue;
-		}
+	}
 
-		ion_sgl_sync_range(a->dev, a->table.sgl, a->table.nents, offset,
-				   len, dir, start);
+	/*
+	 * The range is about to be cleaned; see ion_dma_buf_end_cpu_access().
+	 * Writes racing with the clean fault again and stay dirty.
+	 */
+	if (!start && !ret && dir != DMA_FROM_DEVICE && open <= 0 &&
+	    buffer->dirty_map) {
+		ion_buffer_zap_user(buffer, offset, len);
+		ion_buffer_clear_dirty(buffer, offset, len);
+	}
+
+	for (a = buffer->attachments; a; a = a->next) {
+		if (a->dma_mapped && ion_attachment_contig(a))
+			ion_sgl_sync_range(a->dev, a->table.sgl, a->table.nents,
+					   offset, len, dir, start);
 	}
 
 	return ret;
@@ -646,6 +969,9 @@ struct ion_device *ion_device_create(struct ion_heap_data *heap_data)
 	if (ret)
 		return ERR_PTR(ret);
 
+	idev->debug_root = debugfs_create_dir("ion", NULL);
+	ion_page_pool_debugfs_init(idev->debug_root);
+
 	idev->heap_data = heap_data;
 	return idev;
 }
@@ -29,6 +29,8 @@
 #include <linux/types.h>
 #include <linux/miscdevice.h>
 #include <linux/bitops.h>
+#include <linux/percpu.h>
+#include <linux/sizes.h>
 #include <linux/msm_dma_iommu_mapping.h>
 #include "ion_kernel.h"
 #include "../uapi/ion.h"
@@ -120,6 +122,14 @@ struct ion_vma_list {
  * @vaddr:		the kernel mapping if kmap_cnt is not zero
  * @sg_table:		the sg table for the buffer if dmap_cnt is not zero
  * @vmas:		list of vma's mapping this buffer
+ * @dirty_map:		pages the CPU may have written since the last sync for
+ *			the device, for cached buffers
+ * @dirty_all:		set when the whole buffer must be treated as dirty
+ * @vmas:		shared user mappings whose writes fault into @dirty_map
+ * @vma_lock:		protects @vmas
+ * @mmap_untracked:	a user mapping could not be tracked, so every sync
+ *			for the device covers the whole buffer
+ * @cpu_access:		number of open begin/end_cpu_access brackets
  */
 struct ion_dma_buf_attachment;
 struct ion_buffer {
@@ -137,6 +147,12 @@ struct ion_buffer {
 	size_t size;
 	int kmap_refcount;
 	struct msm_iommu_data iommu_data;
+	unsigned long *dirty_map;
+	bool dirty_all;
+	struct list_head vmas;
+	struct mutex vma_lock;
+	bool mmap_untracked;
+	atomic_t cpu_access;
 };
 
 void ion_buffer_destroy(struct ion_buffer *buffer);
@@ -153,6 +169,7 @@ struct ion_device {
 	struct plist_head heaps;
 	struct ion_heap_data *heap_data;
 	u32 heap_count;
+	struct dentry *debug_root;
 };
 
 /* refer to include/linux/pm.h */
@@ -348,6 +365,35 @@ struct ion_heap *ion_secure_carveout_heap_create(
  * many systems
  */
 
+/*
+ * Each CPU keeps a magazine of up to ION_POOL_MAG_BYTES worth of pages in front
+ * of the shared pool lists, capped at ION_POOL_MAG_MAX pages. Orders too large
+ * to fit a single page in a magazine go straight to the shared lists.
+ */
+#define ION_POOL_MAG_BYTES	SZ_256K
+#define ION_POOL_MAG_MAX	64
+
+/**
+ * struct ion_page_pool_mag - per-cpu page magazine
+ * @lock:		protects the magazine; only contended when the shrinker
+ *			drains it from another cpu
+ * @count:		number of pages in the magazine
+ * @pages:		the cached pages
+ * @mag_hits:		allocations served from the magazine
+ * @pool_hits:		allocations served from the shared lists
+ * @misses:		allocations that fell back to the page allocator
+ * @trylock_fails:	shared list accesses skipped due to lock contention
+ */
+struct ion_page_pool_mag {
+	spinlock_t lock;
+	unsigned int count;
+	struct page *pages[ION_POOL_MAG_MAX];
+	unsigned long mag_hits;
+	unsigned long pool_hits;
+	unsigned long misses;
+	unsigned long trylock_fails;
+};
+
 /**
  * struct ion_page_pool - pagepool struct
  * @high_count:		number of highmem items in the pool
@@ -360,6 +406,9 @@ struct ion_heap *ion_secure_carveout_heap_create(
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
  * @cached:		it's cached pool or not
+ * @mags:		per-cpu magazines in front of the item lists
+ * @mag_size:		capacity of each magazine, 0 if magazines are unused
+ * @pool_list:		entry in the list of all pools, for debugfs
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -377,6 +426,9 @@ struct ion_page_pool {
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	struct ion_page_pool_mag __percpu *mags;
+	unsigned int mag_size;
+	struct list_head pool_list;
 };
 
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
@@ -408,6 +460,12 @@ static inline long ion_page_pool_nr_pages(void) { return 0; }
 int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 			 int nr_to_scan);
 
+/**
+ * ion_page_pool_debugfs_init - create the page pool stats file
+ * @debug_root:		ion's debugfs directory
+ */
+void ion_page_pool_debugfs_init(struct dentry *debug_root);
+
 /**
  * ion_pages_sync_for_device - cache flush pages for use with the specified
  *                             device
@@ -23,15 +23,21 @@
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/sched/signal.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
 
 #include "ion.h"
 
 /*
- * We avoid atomic_long_t to minimize cache flushes at the cost of possible
- * race which would result in a small accounting inaccuracy that we can
- * tolerate.
+ * Pages held by all pools. Per-CPU to avoid bouncing a shared cacheline on
+ * every pool add and remove, since those no longer share a lock; a CPU's
+ * count may go negative, only the sum is meaningful.
  */
-static long nr_total_pages;
+static DEFINE_PER_CPU(long, nr_total_pages);
+
+/* All pools, for debugfs */
+static LIST_HEAD(ion_page_pools);
+static DEFINE_MUTEX(ion_page_pools_lock);
 
 static void *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
 {
@@ -46,9 +52,17 @@ static void ion_page_pool_free_pages(struct ion_page_pool *pool,
 	__free_pages(page, pool->order);
 }
 
-static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
+static void ion_page_pool_account(struct ion_page_pool *pool,
+				  struct page *page, long nr)
+{
+	this_cpu_add(nr_total_pages, nr);
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE, nr);
+}
+
+/* pool->lock must be held */
+static void ion_page_pool_list_add(struct ion_page_pool *pool,
+				   struct page *page)
 {
-	spin_lock(&pool->lock);
 	if (PageHighMem(page)) {
 		list_add_tail(&page->lru, &pool->high_items);
 		pool->high_count++;
@@ -56,14 +70,9 @@ static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
 		list_add_tail(&page->lru, &pool->low_items);
 		pool->low_count++;
 	}
-
-	nr_total_pages += 1 << pool->order;
-	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
-							1 << pool->order);
-	spin_unlock(&pool->lock);
-	return 0;
 }
 
+/* pool->lock must be held */
 static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 {
 	struct page *page;
@@ -79,27 +88,156 @@ static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 	}
 
 	list_del(&page->lru);
-	nr_total_pages -= 1 << pool->order;
-	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
-							-(1 << pool->order));
 	return page;
 }
 
-struct page *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
+/*
+ * Refill half of an empty magazine from the shared lists. This only trylocks
+ * the pool, as the caller would rather go to the page allocator than wait.
+ * mag->lock must be held.
+ */
+static void ion_page_pool_mag_refill(struct ion_page_pool *pool,
+				     struct ion_page_pool_mag *mag)
 {
-	struct page *page = NULL;
+	unsigned int batch = max(pool->mag_size / 2, 1U);
 
-	BUG_ON(!pool);
+	if (!spin_trylock(&pool->lock)) {
+		mag->trylock_fails++;
+		return;
+	}
 
-	if (fatal_signal_pending(current))
-		return ERR_PTR(-EINTR);
+	while (mag->count < batch) {
+		if (pool->high_count)
+			mag->pages[mag->count++] =
+				ion_page_pool_remove(pool, true);
+		else if (pool->low_count)
+			mag->pages[mag->count++] =
+				ion_page_pool_remove(pool, false);
+		else
+			break;
+	}
+	spin_unlock(&pool->lock);
+}
+
+/*
+ * Move the nr oldest pages of a magazine to the shared lists. mag->lock must
+ * be held.
+ */
+static void ion_page_pool_mag_spill(struct ion_page_pool *pool,
+				    struct ion_page_pool_mag *mag,
+				    unsigned int nr)
+{
+	unsigned int i;
+
+	spin_lock(&pool->lock);
+	for (i = 0; i < nr; i++)
+		ion_page_pool_list_add(pool, mag->pages[i]);
+	spin_unlock(&pool->lock);
+
+	mag->count -= nr;
+	memmove(mag->pages, mag->pages + nr, mag->count * sizeof(*mag->pages));
+}
+
+static void ion_page_pool_drain_mags(struct ion_page_pool *pool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct ion_page_pool_mag *mag = per_cpu_ptr(pool->mags, cpu);
+
+		spin_lock(&mag->lock);
+		if (mag->count)
+			ion_page_pool_mag_spill(pool, mag, mag->count);
+		spin_unlock(&mag->lock);
+	}
+}
+
+static unsigned int ion_page_pool_mag_count(struct ion_page_pool *pool)
+{
+	unsigned int count = 0;
+	int cpu;
+
+	if (!pool->mag_size)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu_ptr(pool->mags, cpu)->count);
+
+	return count;
+}
+
+static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
+{
+	ion_page_pool_account(pool, page, 1 << pool->order);
+
+	if (pool->mag_size) {
+		struct ion_page_pool_mag *mag = raw_cpu_ptr(pool->mags);
+
+		spin_lock(&mag->lock);
+		if (mag->count == pool->mag_size)
+			ion_page_pool_mag_spill(pool, mag,
+						max(pool->mag_size / 2, 1U));
+		mag->pages[mag->count++] = page;
+		spin_unlock(&mag->lock);
+		return 0;
+	}
+
+	spin_lock(&pool->lock);
+	ion_page_pool_list_add(pool, page);
+	spin_unlock(&pool->lock);
+	return 0;
+}
+
+/* Take a page from this cpu's magazine or the shared lists */
+static struct page *ion_page_pool_get(struct ion_page_pool *pool)
+{
+	struct page *page = NULL;
 
-	if (*from_pool && spin_trylock(&pool->lock)) {
+	if (pool->mag_size) {
+		struct ion_page_pool_mag *mag = raw_cpu_ptr(pool->mags);
+
+		spin_lock(&mag->lock);
+		if (mag->count) {
+			page = mag->pages[--mag->count];
+			mag->mag_hits++;
+		} else {
+			ion_page_pool_mag_refill(pool, mag);
+			if (mag->count) {
+				page = mag->pages[--mag->count];
+				mag->pool_hits++;
+			}
+		}
+		spin_unlock(&mag->lock);
+	} else if (spin_trylock(&pool->lock)) {
 		if (pool->high_count)
 			page = ion_page_pool_remove(pool, true);
 		else if (pool->low_count)
 			page = ion_page_pool_remove(pool, false);
 		spin_unlock(&pool->lock);
+		if (page)
+			this_cpu_inc(pool->mags->pool_hits);
+	} else {
+		this_cpu_inc(pool->mags->trylock_fails);
+	}
+
+	if (page)
+		ion_page_pool_account(pool, page, -(1 << pool->order));
+	return page;
+}
+
+struct page *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
+{
+	struct page *page = NULL;
+
+	BUG_ON(!pool);
+
+	if (fatal_signal_pending(current))
+		return ERR_PTR(-EINTR);
+
+	if (*from_pool) {
+		page = ion_page_pool_get(pool);
+		if (!page)
+			this_cpu_inc(pool->mags->misses);
 	}
 	if (!page) {
 		page = ion_page_pool_alloc_pages(pool);
@@ -116,19 +254,12 @@ struct page *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
  */
 struct page *ion_page_pool_alloc_pool_only(struct ion_page_pool *pool)
 {
-	struct page *page = NULL;
+	struct page *page;
 
 	if (!pool)
 		return ERR_PTR(-EINVAL);
 
-	if (spin_trylock(&pool->lock)) {
-		if (pool->high_count)
-			page = ion_page_pool_remove(pool, true);
-		else if (pool->low_count)
-			page = ion_page_pool_remove(pool, false);
-		spin_unlock(&pool->lock);
-	}
-
+	page = ion_page_pool_get(pool);
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 	return page;
@@ -148,9 +279,13 @@ void ion_page_pool_free_immediate(struct ion_page_pool *pool, struct page *page)
 	ion_page_pool_free_pages(pool, page);
 }
 
+/*
+ * Magazine pages aren't sorted by zone, so they are counted as lowmem. They
+ * only hold highmem pages on 32-bit targets with highmem.
+ */
 int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 {
-	int count = pool->low_count;
+	int count = pool->low_count + ion_page_pool_mag_count(pool);
 
 	if (high)
 		count += pool->high_count;
@@ -161,16 +296,21 @@ int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 #ifdef CONFIG_ION_SYSTEM_HEAP
 long ion_page_pool_nr_pages(void)
 {
-	/* Correct possible overflow caused by racing writes */
-	if (nr_total_pages < 0)
-		nr_total_pages = 0;
-	return nr_total_pages;
+	long nr = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		nr += per_cpu(nr_total_pages, cpu);
+
+	/* The sum can be briefly negative while a CPU's update is in flight */
+	return max(nr, 0L);
 }
 #endif
 
 int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 			 int nr_to_scan)
 {
+	bool drained = false;
 	int freed = 0;
 	bool high;
 
@@ -192,9 +332,15 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 			page = ion_page_pool_remove(pool, true);
 		} else {
 			spin_unlock(&pool->lock);
-			break;
+			/* Pull the per-cpu magazines back in before giving up */
+			if (drained || !pool->mag_size)
+				break;
+			ion_page_pool_drain_mags(pool);
+			drained = true;
+			continue;
 		}
 		spin_unlock(&pool->lock);
+		ion_page_pool_account(pool, page, -(1 << pool->order));
 		ion_page_pool_free_pages(pool, page);
 		freed += (1 << pool->order);
 	}
@@ -206,9 +352,20 @@ struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
 					   bool cached)
 {
 	struct ion_page_pool *pool = kmalloc(sizeof(*pool), GFP_KERNEL);
+	int cpu;
 
 	if (!pool)
 		return NULL;
+	pool->mags = alloc_percpu(struct ion_page_pool_mag);
+	if (!pool->mags) {
+		kfree(pool);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(pool->mags, cpu)->lock);
+	pool->mag_size = min_t(unsigned int,
+			       ION_POOL_MAG_BYTES >> (PAGE_SHIFT + order),
+			       ION_POOL_MAG_MAX);
 	pool->high_count = 0;
 	pool->low_count = 0;
 	INIT_LIST_HEAD(&pool->low_items);
@@ -220,16 +377,71 @@ struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order,
 	if (cached)
 		pool->cached = true;
 
+	mutex_lock(&ion_page_pools_lock);
+	list_add_tail(&pool->pool_list, &ion_page_pools);
+	mutex_unlock(&ion_page_pools_lock);
+
 	return pool;
 }
 
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	mutex_lock(&ion_page_pools_lock);
+	list_del(&pool->pool_list);
+	mutex_unlock(&ion_page_pools_lock);
+	/* Frees the pooled pages, magazines included */
+	ion_page_pool_shrink(pool, __GFP_HIGHMEM, INT_MAX);
+	free_percpu(pool->mags);
 	kfree(pool);
 }
 
-static int __init ion_page_pool_init(void)
+static int ion_page_pool_stats_show(struct seq_file *s, void *unused)
 {
+	unsigned int order;
+
+	seq_printf(s, "%5s %10s %10s %10s %10s %10s %10s\n", "order", "pages",
+		   "magazine", "mag_hits", "pool_hits", "misses",
+		   "trylock_fail");
+
+	mutex_lock(&ion_page_pools_lock);
+	for (order = 0; order < MAX_ORDER; order++) {
+		unsigned long pages = 0, mag_pages = 0, mag_hits = 0;
+		unsigned long pool_hits = 0, misses = 0, trylock_fails = 0;
+		struct ion_page_pool *pool;
+		bool found = false;
+		int cpu;
+
+		list_for_each_entry(pool, &ion_page_pools, pool_list) {
+			if (pool->order != order)
+				continue;
+
+			found = true;
+			pages += ion_page_pool_total(pool, true);
+			mag_pages += ion_page_pool_mag_count(pool) << order;
+			for_each_possible_cpu(cpu) {
+				struct ion_page_pool_mag *mag =
+					per_cpu_ptr(pool->mags, cpu);
+
+				mag_hits += mag->mag_hits;
+				pool_hits += mag->pool_hits;
+				misses += mag->misses;
+				trylock_fails += mag->trylock_fails;
+			}
+		}
+
+		if (found)
+			seq_printf(s, "%5u %10lu %10lu %10lu %10lu %10lu %10lu\n",
+				   order, pages, mag_pages, mag_hits, pool_hits,
+				   misses, trylock_fails);
+	}
+	mutex_unlock(&ion_page_pools_lock);
+
 	return 0;
 }
-device_initcall(ion_page_pool_init);
+DEFINE_SHOW_ATTRIBUTE(ion_page_pool_stats);
+
+void ion_page_pool_debugfs_init(struct dentry *debug_root)
+{
+	debugfs_create_file("page_pool_stats", 0444, debug_root, NULL,
+			    &ion_page_pool_stats_fops);
+}
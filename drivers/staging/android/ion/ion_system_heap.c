@@ -16,10 +16,14 @@
  */
 
 #include <asm/page.h>
+#include <linux/delay.h>
 #include <linux/dma-mapping.h>
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/highmem.h>
+#include <linux/kthread.h>
 #include <linux/mm.h>
+#include <linux/moduleparam.h>
 #include <linux/scatterlist.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
@@ -35,6 +39,19 @@ static gfp_t high_order_gfp_flags = (GFP_HIGHUSER | __GFP_ZERO | __GFP_NOWARN |
 				     __GFP_NORETRY) & ~__GFP_RECLAIM;
 static gfp_t low_order_gfp_flags  = GFP_HIGHUSER | __GFP_ZERO;
 
+/*
+ * MiB of memory to keep in the non-secure pools, split evenly between the
+ * cached and uncached pool of every order; 0 disables refilling
+ */
+static unsigned int pool_refill_mb = CONFIG_ION_POOL_REFILL_MB;
+module_param(pool_refill_mb, uint, 0644);
+
+/* Don't refill the pools for this long after the shrinker has run */
+#define ION_POOL_REFILL_BACKOFF (5 * HZ)
+
+/* Wait this long after an allocation before refilling, to batch them up */
+#define ION_POOL_REFILL_DELAY_MS 100
+
 int order_to_index(unsigned int order)
 {
 	int i;
@@ -402,6 +419,10 @@ static int ion_system_heap_allocate(struct ion_heap *heap,
 	if (nents_sync)
 		sg_free_table(&table_sync);
 	ion_heap_free_pages_mem(&data);
+
+	if (!is_secure_vmid_valid(vmid) &&
+	    !atomic_xchg(&sys_heap->refill_pending, 1))
+		wake_up(&sys_heap->refill_wq);
 	return 0;
 
 err_free_sg2:
@@ -494,6 +515,8 @@ static int ion_system_heap_shrink(struct ion_heap *heap, gfp_t gfp_mask,
 		nr_total += nr_freed;
 
 		if (!only_scan) {
+			if (nr_freed)
+				WRITE_ONCE(sys_heap->last_shrink, jiffies);
 			nr_to_scan -= nr_freed;
 			/* shrink completed */
 			if (nr_to_scan <= 0)
@@ -513,6 +536,84 @@ static struct ion_heap_ops system_heap_ops = {
 	.shrink = ion_system_heap_shrink,
 };
 
+static bool ion_system_heap_refill_backoff(struct ion_system_heap *heap)
+{
+	return time_before(jiffies, READ_ONCE(heap->last_shrink) +
+				    ION_POOL_REFILL_BACKOFF);
+}
+
+/*
+ * Top up a pool with pages that are already zeroed and clean in the cache, so
+ * they can be handed out exactly like pages freed back to the pool. Only free
+ * memory is used; this never enters reclaim. Returns false if refilling
+ * should stop altogether.
+ */
+static bool ion_system_heap_refill_pool(struct ion_system_heap *heap,
+					struct ion_page_pool *pool,
+					unsigned long target)
+{
+	gfp_t gfp = (pool->gfp_mask | __GFP_NORETRY | __GFP_NOWARN) &
+		    ~__GFP_RECLAIM;
+	struct device *dev = heap->heap.priv;
+
+	while (ion_page_pool_total(pool, true) < target) {
+		struct page *page;
+
+		if (kthread_should_stop() ||
+		    ion_system_heap_refill_backoff(heap))
+			return false;
+
+		page = alloc_pages(gfp, pool->order);
+		if (!page)
+			break;
+
+		ion_pages_sync_for_device(dev, page, PAGE_SIZE << pool->order,
+					  DMA_BIDIRECTIONAL);
+		ion_page_pool_free(pool, page);
+		cond_resched();
+	}
+
+	return true;
+}
+
+static int ion_system_heap_refill_thread(void *data)
+{
+	struct ion_system_heap *heap = data;
+	unsigned long target;
+	int i;
+
+	set_user_nice(current, MAX_NICE);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(heap->refill_wq,
+				     atomic_read(&heap->refill_pending) ||
+				     kthread_should_stop());
+
+		msleep(ION_POOL_REFILL_DELAY_MS);
+		atomic_set(&heap->refill_pending, 0);
+
+		/* Pages per pool */
+		target = ((unsigned long)READ_ONCE(pool_refill_mb) <<
+			  (20 - PAGE_SHIFT)) / (2 * NUM_ORDERS);
+		if (!target || ion_system_heap_refill_backoff(heap))
+			continue;
+
+		for (i = 0; i < NUM_ORDERS; i++) {
+			if (!ion_system_heap_refill_pool(heap,
+						heap->uncached_pools[i],
+						target))
+				break;
+			if (!ion_system_heap_refill_pool(heap,
+						heap->cached_pools[i],
+						target))
+				break;
+		}
+	}
+
+	return 0;
+}
+
 static void ion_system_heap_destroy_pools(struct ion_page_pool **pools)
 {
 	int i;
@@ -578,6 +679,17 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *data)
 
 	mutex_init(&heap->split_page_mutex);
 
+	/* Fill the pools once at boot, then after allocations drain them */
+	init_waitqueue_head(&heap->refill_wq);
+	atomic_set(&heap->refill_pending, 1);
+	heap->last_shrink = jiffies - ION_POOL_REFILL_BACKOFF;
+	heap->refill_task = kthread_run(ion_system_heap_refill_thread, heap,
+					"ion_pool_refill");
+	if (IS_ERR(heap->refill_task)) {
+		pr_err("%s: failed to start pool refill thread\n", __func__);
+		heap->refill_task = NULL;
+	}
+
 	return &heap->heap;
 
 destroy_uncached_pools:
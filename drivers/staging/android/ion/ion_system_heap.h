@@ -34,6 +34,11 @@ struct ion_system_heap {
 	struct ion_page_pool *secure_pools[VMID_LAST][MAX_ORDER];
 	/* Prevents unnecessary page splitting */
 	struct mutex split_page_mutex;
+	/* Background pool refill */
+	struct task_struct *refill_task;
+	wait_queue_head_t refill_wq;
+	atomic_t refill_pending;
+	unsigned long last_shrink;
 };
 
 struct page_info {
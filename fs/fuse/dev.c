@@ -22,13 +22,34 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/sched/mm.h>
 #include <linux/freezer.h>
+#include <linux/eventfd.h>
+#include <linux/log2.h>
+#include <linux/mempool.h>
+#include <linux/vmalloc.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
+/*
+ * Page arrays for requests above FUSE_DEFAULT_MAX_PAGES_PER_REQ hold the
+ * page pointers followed by the page descriptors in one kvmalloc() object
+ * sized for the request.  If that fails, the request falls back to a
+ * mempool of arrays for FUSE_MAX_MAX_PAGES pages.  Those are still order-2
+ * slab objects, but a few are kept in reserve, so large I/O can make
+ * progress under memory pressure.
+ */
+#define FUSE_PAGE_ARRAY_SIZE \
+	(FUSE_MAX_MAX_PAGES * \
+	 (sizeof(struct page *) + sizeof(struct fuse_page_desc)))
+#define FUSE_PAGE_ARRAY_RESERVE 4
+
+static struct kmem_cache *fuse_page_array_cachep;
+static mempool_t *fuse_page_array_pool;
+
 static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
@@ -55,30 +76,77 @@ static void fuse_request_init(struct fuse_req *req, struct page **pages,
 	__set_bit(FR_PENDING, &req->flags);
 }
 
+static struct page **fuse_req_pages_alloc(unsigned int npages, gfp_t flags,
+					  struct fuse_page_desc **desc,
+					  bool *from_pool)
+{
+	struct page **pages;
+	unsigned int nofs_flags;
+
+	*from_pool = false;
+	if (npages <= FUSE_DEFAULT_MAX_PAGES_PER_REQ) {
+		pages = kmalloc(sizeof(struct page *) * npages, flags);
+		*desc = kmalloc(sizeof(struct fuse_page_desc) * npages, flags);
+		if (!pages || !*desc) {
+			kfree(pages);
+			kfree(*desc);
+			return NULL;
+		}
+		return pages;
+	}
+
+	/*
+	 * kvmalloc() only falls back to vmalloc() for GFP_KERNEL, so scope
+	 * the writeback path's GFP_NOFS instead of passing it.
+	 */
+	nofs_flags = memalloc_nofs_save();
+	pages = kvmalloc(npages * (sizeof(struct page *) +
+				   sizeof(struct fuse_page_desc)),
+			 flags | __GFP_FS | __GFP_NOWARN);
+	memalloc_nofs_restore(nofs_flags);
+	if (!pages && npages <= FUSE_MAX_MAX_PAGES) {
+		pages = mempool_alloc(fuse_page_array_pool, flags);
+		*from_pool = true;
+	}
+	if (pages)
+		*desc = (void *)(pages + npages);
+	return pages;
+}
+
+static void fuse_req_pages_free(struct fuse_req *req)
+{
+	if (req->pages_from_pool) {
+		mempool_free(req->pages, fuse_page_array_pool);
+	} else if (req->max_pages > FUSE_DEFAULT_MAX_PAGES_PER_REQ) {
+		kvfree(req->pages);
+	} else if (req->pages != req->inline_pages) {
+		kfree(req->pages);
+		kfree(req->page_descs);
+	}
+}
+
 static struct fuse_req *__fuse_request_alloc(unsigned npages, gfp_t flags)
 {
 	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, flags);
 	if (req) {
 		struct page **pages;
 		struct fuse_page_desc *page_descs;
+		bool from_pool = false;
 
 		if (npages <= FUSE_REQ_INLINE_PAGES) {
 			pages = req->inline_pages;
 			page_descs = req->inline_page_descs;
 		} else {
-			pages = kmalloc(sizeof(struct page *) * npages, flags);
-			page_descs = kmalloc(sizeof(struct fuse_page_desc) *
-					     npages, flags);
-		}
-
-		if (!pages || !page_descs) {
-			kfree(pages);
-			kfree(page_descs);
-			kmem_cache_free(fuse_req_cachep, req);
-			return NULL;
+			pages = fuse_req_pages_alloc(npages, flags, &page_descs,
+						     &from_pool);
+			if (!pages) {
+				kmem_cache_free(fuse_req_cachep, req);
+				return NULL;
+			}
 		}
 
 		fuse_request_init(req, pages, page_descs, npages);
+		req->pages_from_pool = from_pool;
 	}
 	return req;
 }
@@ -94,12 +162,44 @@ struct fuse_req *fuse_request_alloc_nofs(unsigned npages)
 	return __fuse_request_alloc(npages, GFP_NOFS);
 }
 
+/*
+ * Grow the page array of a request being filled, doubling it up to
+ * fc->max_pages, so that callers don't have to allocate for the largest
+ * request up front.
+ */
+bool fuse_req_realloc_pages(struct fuse_conn *fc, struct fuse_req *req,
+			    gfp_t flags)
+{
+	struct page **pages;
+	struct fuse_page_desc *page_descs;
+	unsigned int npages = min_t(unsigned int,
+				    max_t(unsigned int, req->max_pages * 2,
+					  FUSE_DEFAULT_MAX_PAGES_PER_REQ),
+				    fc->max_pages);
+	bool from_pool;
+
+	if (npages <= req->max_pages)
+		return false;
+
+	pages = fuse_req_pages_alloc(npages, flags, &page_descs, &from_pool);
+	if (!pages)
+		return false;
+
+	memcpy(pages, req->pages, sizeof(struct page *) * req->max_pages);
+	memcpy(page_descs, req->page_descs,
+	       sizeof(struct fuse_page_desc) * req->max_pages);
+	fuse_req_pages_free(req);
+	req->pages = pages;
+	req->page_descs = page_descs;
+	req->max_pages = npages;
+	req->pages_from_pool = from_pool;
+
+	return true;
+}
+
 void fuse_request_free(struct fuse_req *req)
 {
-	if (req->pages != req->inline_pages) {
-		kfree(req->pages);
-		kfree(req->page_descs);
-	}
+	fuse_req_pages_free(req);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -321,12 +421,56 @@ static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 	return ++fiq->reqctr;
 }
 
+/*
+ * Pick and lock the input queue for a request submitted on this CPU: its
+ * per-CPU queue if a device is bound to it, the main queue otherwise.
+ */
+static struct fuse_iqueue *fuse_lock_iq(struct fuse_conn *fc)
+{
+	struct fuse_iqueue *iqs = smp_load_acquire(&fc->cpu_iqs);
+
+	if (iqs) {
+		struct fuse_iqueue *fiq = &iqs[raw_smp_processor_id()];
+
+		if (READ_ONCE(fiq->nr_devs)) {
+			spin_lock(&fiq->waitq.lock);
+			if (fiq->nr_devs)
+				return fiq;
+			spin_unlock(&fiq->waitq.lock);
+		}
+	}
+
+	spin_lock(&fc->iq.waitq.lock);
+	return &fc->iq;
+}
+
+/*
+ * Lock the input queue a pending request is on. Unbinding the last device
+ * from a per-CPU queue moves its requests to the main queue, so recheck
+ * once the lock is held.
+ */
+static struct fuse_iqueue *fuse_lock_req_iq(struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq);
+		spin_lock(&fiq->waitq.lock);
+		if (req->fiq == fiq)
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
+	if (fiq->ring_efd)
+		eventfd_signal(fiq->ring_efd, 1);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 }
 
@@ -355,12 +499,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_iq(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
@@ -437,7 +581,7 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -451,7 +595,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		/* matches barrier in fuse_dev_do_read() */
 		smp_mb__after_atomic();
 		if (test_bit(FR_SENT, &req->flags))
-			queue_interrupt(fiq, req);
+			queue_interrupt(&fc->iq, req);
 	}
 
 	if (!test_bit(FR_FORCE, &req->flags)) {
@@ -461,7 +605,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_req_iq(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -484,10 +628,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iq(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
@@ -1259,29 +1403,58 @@ __releases(fiq->waitq.lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
+/*
+ * Pipe buffers needed to splice @req to userspace: the header and in-line
+ * arguments are copied into fresh pages, while the page argument, which is
+ * always the last one, takes a buffer per page.
+ */
+static unsigned int fuse_req_pipe_bufs(struct fuse_req *req)
+{
+	struct fuse_in *in = &req->in;
+	unsigned int len = in->h.len;
+	unsigned int nbufs = 0;
+
+	if (in->argpages) {
+		len -= in->args[in->numargs - 1].size;
+		nbufs = req->num_pages;
+	}
+
+	return nbufs + DIV_ROUND_UP(len, PAGE_SIZE);
+}
+
 static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *bound;
+	struct fuse_iqueue *fiq;
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
+	bound = READ_ONCE(fud->iq);
+	fiq = bound ?: &fc->iq;
 	spin_lock(&fiq->waitq.lock);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fiq->connected &&
 	    !request_pending(fiq))
 		goto err_unlock;
 
+	/* The device may be moved to the main queue while we sleep */
 	err = wait_event_interruptible_exclusive_locked(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
+				!fiq->connected || request_pending(fiq) ||
+				READ_ONCE(fud->iq) != bound);
 	if (err)
 		goto err_unlock;
 
+	if (READ_ONCE(fud->iq) != bound) {
+		spin_unlock(&fiq->waitq.lock);
+		goto restart;
+	}
+
 	if (!fiq->connected) {
 		err = (fc->aborted && fc->abort_err) ? -ECONNABORTED : -ENODEV;
 		goto err_unlock;
@@ -1302,6 +1475,15 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	}
 
 	req = list_entry(fiq->pending.next, struct fuse_req, list);
+	/*
+	 * A request that cannot fit in the pipe would fail halfway through
+	 * the copy.  Leave it queued so the server can enlarge the pipe or
+	 * pick it up with read() instead.
+	 */
+	if (cs->pipe && fuse_req_pipe_bufs(req) > cs->pipe->buffers) {
+		err = -E2BIG;
+		goto err_unlock;
+	}
 	clear_bit(FR_PENDING, &req->flags);
 	list_del_init(&req->list);
 	spin_unlock(&fiq->waitq.lock);
@@ -1364,7 +1546,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(&fc->iq, req);
 	fuse_put_request(fc, req);
 
 	return reqsize;
@@ -1422,7 +1604,8 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	if (!fud)
 		return -EPERM;
 
-	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
+	bufs = kvmalloc_array(pipe->buffers, sizeof(struct pipe_buffer),
+			      GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
@@ -1455,7 +1638,7 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	for (; page_nr < cs.nr_segs; page_nr++)
 		put_page(bufs[page_nr].page);
 
-	kfree(bufs);
+	kvfree(bufs);
 	return ret;
 }
 
@@ -1723,7 +1906,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		num = file_size - outarg->offset;
 
 	num_pages = (num + offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
-	num_pages = min(num_pages, FUSE_MAX_PAGES_PER_REQ);
+	num_pages = min_t(int, num_pages, fc->max_pages);
 
 	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
@@ -2017,7 +2200,8 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 
 	pipe_lock(pipe);
 
-	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
+	bufs = kvmalloc_array(pipe->buffers, sizeof(struct pipe_buffer),
+			      GFP_KERNEL);
 	if (!bufs) {
 		pipe_unlock(pipe);
 		return -ENOMEM;
@@ -2082,10 +2266,380 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	kfree(bufs);
+	kvfree(bufs);
 	return ret;
 }
 
+/*
+ * Shared memory ring.
+ *
+ * Small requests are handed to the daemon through request slots in memory
+ * it has mapped, and replies come back through completion slots, so a whole
+ * batch costs one FUSE_DEV_IOC_RING_ENTER instead of a read() and a write()
+ * per request. Requests carrying pages, and anything that doesn't fit in a
+ * slot, stay on the input queue for read() as before, as do forgets and
+ * interrupts.
+ */
+#define FUSE_RING_MAX_ENTRIES 4096
+#define FUSE_RING_MIN_ENTRY_SIZE 512
+#define FUSE_RING_MAX_ENTRY_SIZE (64 * 1024)
+#define FUSE_RING_MAX_SIZE (64 * 1024 * 1024)
+
+static bool fuse_ring_fits(struct fuse_ring *ring, struct fuse_req *req)
+{
+	if (!test_bit(FR_ISREPLY, &req->flags) || req->in.argpages ||
+	    req->out.argpages)
+		return false;
+
+	/* Needs kern_path() on the reply, see fuse_dev_do_write() */
+	if (req->in.h.opcode == FUSE_CANONICAL_PATH)
+		return false;
+
+	return req->in.h.len <= ring->entry_size &&
+	       sizeof(struct fuse_out_header) +
+			len_args(req->out.numargs, req->out.args) <=
+		       ring->entry_size;
+}
+
+static void fuse_ring_copy_in(u8 *slot, struct fuse_in *in)
+{
+	struct fuse_arg *args = (struct fuse_arg *) in->args;
+	unsigned int i;
+
+	memcpy(slot, &in->h, sizeof(in->h));
+	slot += sizeof(in->h);
+	for (i = 0; i < in->numargs; i++) {
+		memcpy(slot, args[i].value, args[i].size);
+		slot += args[i].size;
+	}
+}
+
+/* Like copy_out_args(), for a reply sitting in a completion slot */
+static int fuse_ring_copy_out(struct fuse_out *out, const u8 *slot,
+			      unsigned int nbytes)
+{
+	unsigned int reqsize = sizeof(struct fuse_out_header);
+	unsigned int i;
+
+	if (out->h.error)
+		return nbytes != reqsize ? -EINVAL : 0;
+
+	reqsize += len_args(out->numargs, out->args);
+
+	if (reqsize < nbytes || (reqsize > nbytes && !out->argvar))
+		return -EINVAL;
+	else if (reqsize > nbytes) {
+		struct fuse_arg *lastarg = &out->args[out->numargs-1];
+		unsigned int diffsize = reqsize - nbytes;
+
+		if (diffsize > lastarg->size)
+			return -EINVAL;
+		lastarg->size -= diffsize;
+	}
+
+	slot += sizeof(struct fuse_out_header);
+	for (i = 0; i < out->numargs; i++) {
+		memcpy(out->args[i].value, slot, out->args[i].size);
+		slot += out->args[i].size;
+	}
+	return 0;
+}
+
+/* Finish the request whose reply is in a completion slot */
+static int fuse_ring_complete_one(struct fuse_dev *fud, const u8 *slot)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_pqueue *fpq = &fud->pq;
+	struct fuse_ring *ring = fud->ring;
+	struct fuse_out_header oh;
+	struct fuse_req *req;
+	int err;
+
+	/* The daemon may scribble on the slot, only trust the local copy */
+	memcpy(&oh, slot, sizeof(oh));
+	if (oh.len < sizeof(oh) || oh.len > ring->entry_size || !oh.unique ||
+	    oh.error <= -512 || oh.error > 0)
+		return -EINVAL;
+
+	spin_lock(&fpq->lock);
+	err = -ENOENT;
+	if (!fpq->connected)
+		goto err_unlock_pq;
+
+	/* Interrupt replies go through write() */
+	req = request_find(fpq, oh.unique);
+	if (!req || req->intr_unique == oh.unique)
+		goto err_unlock_pq;
+
+	clear_bit(FR_SENT, &req->flags);
+	list_move(&req->list, &fpq->io);
+	req->out.h = oh;
+	set_bit(FR_LOCKED, &req->flags);
+	spin_unlock(&fpq->lock);
+
+	err = fuse_ring_copy_out(&req->out, slot, oh.len);
+
+	spin_lock(&fpq->lock);
+	clear_bit(FR_LOCKED, &req->flags);
+	if (!fpq->connected)
+		err = -ENOENT;
+	else if (err)
+		req->out.h.error = -EIO;
+	if (!test_bit(FR_PRIVATE, &req->flags))
+		list_del_init(&req->list);
+	spin_unlock(&fpq->lock);
+
+	request_end(fc, req);
+	return err;
+
+ err_unlock_pq:
+	spin_unlock(&fpq->lock);
+	return err;
+}
+
+static void fuse_ring_reap(struct fuse_dev *fud, struct fuse_ring *ring)
+{
+	u32 head = ring->cmp_head;
+	u32 tail = smp_load_acquire(&ring->hdr->cmp_tail);
+
+	/* Ignore a tail that claims more completions than there are slots */
+	if (tail - head > ring->entries)
+		return;
+
+	for (; head != tail; head++)
+		fuse_ring_complete_one(fud, ring->cmp_slots +
+				(head & (ring->entries - 1)) * ring->entry_size);
+
+	ring->cmp_head = head;
+	smp_store_release(&ring->hdr->cmp_head, head);
+}
+
+/*
+ * Move pending requests that fit into free request slots. Returns the
+ * number of requests handed over, or an error if none were: -E2BIG means
+ * the request at the head of the queue has to be picked up with read().
+ */
+static int fuse_ring_fill(struct fuse_dev *fud, struct fuse_ring *ring,
+			  bool wait)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *bound = READ_ONCE(fud->iq);
+	struct fuse_iqueue *fiq = bound ?: &fc->iq;
+	struct fuse_pqueue *fpq = &fud->pq;
+	u32 tail = ring->req_tail;
+	u32 head = smp_load_acquire(&ring->hdr->req_head);
+	struct fuse_req *req;
+	int pushed = 0;
+	int err = 0;
+
+	while (tail - head < ring->entries) {
+		spin_lock(&fiq->waitq.lock);
+		if (!pushed && wait && fiq->connected)
+			err = wait_event_interruptible_locked(fiq->waitq,
+					!fiq->connected ||
+					!list_empty(&fiq->pending) ||
+					READ_ONCE(fud->iq) != bound);
+		/* Moved to the main queue, let the caller enter again */
+		if (err || READ_ONCE(fud->iq) != bound) {
+			spin_unlock(&fiq->waitq.lock);
+			break;
+		}
+		if (!fiq->connected) {
+			spin_unlock(&fiq->waitq.lock);
+			err = (fc->aborted && fc->abort_err) ?
+				-ECONNABORTED : -ENODEV;
+			break;
+		}
+		if (list_empty(&fiq->pending)) {
+			spin_unlock(&fiq->waitq.lock);
+			break;
+		}
+
+		/*
+		 * Leave it, and whatever is queued behind it, to read(). If
+		 * nothing was pushed, say so, or a waiting caller would spin
+		 * on a queue that never gets empty.
+		 */
+		req = list_entry(fiq->pending.next, struct fuse_req, list);
+		if (!fuse_ring_fits(ring, req)) {
+			spin_unlock(&fiq->waitq.lock);
+			err = -E2BIG;
+			break;
+		}
+		clear_bit(FR_PENDING, &req->flags);
+		list_del_init(&req->list);
+		spin_unlock(&fiq->waitq.lock);
+
+		if (task_active_pid_ns(current) != fc->pid_ns) {
+			rcu_read_lock();
+			req->in.h.pid = pid_vnr(find_pid_ns(req->in.h.pid,
+							    fc->pid_ns));
+			rcu_read_unlock();
+		}
+
+		fuse_ring_copy_in(ring->req_slots +
+				(tail & (ring->entries - 1)) * ring->entry_size,
+				&req->in);
+
+		spin_lock(&fpq->lock);
+		if (!fpq->connected) {
+			spin_unlock(&fpq->lock);
+			req->out.h.error = -ECONNABORTED;
+			request_end(fc, req);
+			err = -ECONNABORTED;
+			break;
+		}
+		list_add_tail(&req->list, &fpq->processing);
+		__fuse_get_request(req);
+		set_bit(FR_SENT, &req->flags);
+		spin_unlock(&fpq->lock);
+		/* matches barrier in request_wait_answer() */
+		smp_mb__after_atomic();
+		if (test_bit(FR_INTERRUPTED, &req->flags))
+			queue_interrupt(&fc->iq, req);
+		fuse_put_request(fc, req);
+
+		tail++;
+		pushed++;
+	}
+
+	if (pushed) {
+		ring->req_tail = tail;
+		smp_store_release(&ring->hdr->req_tail, tail);
+	}
+
+	return pushed ?: err;
+}
+
+static long fuse_ring_enter(struct fuse_dev *fud, u32 flags)
+{
+	struct fuse_ring *ring = READ_ONCE(fud->ring);
+	long res;
+
+	if (!ring)
+		return -EINVAL;
+
+	mutex_lock(&ring->lock);
+	fuse_ring_reap(fud, ring);
+	res = fuse_ring_fill(fud, ring, flags & FUSE_RING_ENTER_WAIT);
+	mutex_unlock(&ring->lock);
+
+	return res;
+}
+
+static int fuse_ring_setup(struct fuse_dev *fud,
+			   struct fuse_ring_setup __user *argp)
+{
+	struct fuse_iqueue *fiq = READ_ONCE(fud->iq) ?: &fud->fc->iq;
+	struct fuse_ring_setup setup;
+	struct fuse_ring *ring;
+	size_t slots;
+	int err;
+
+	if (copy_from_user(&setup, argp, sizeof(setup)))
+		return -EFAULT;
+
+	if (!setup.entries || setup.entries > FUSE_RING_MAX_ENTRIES ||
+	    !is_power_of_2(setup.entries) ||
+	    setup.entry_size < FUSE_RING_MIN_ENTRY_SIZE ||
+	    setup.entry_size > FUSE_RING_MAX_ENTRY_SIZE ||
+	    !IS_ALIGNED(setup.entry_size, 8))
+		return -EINVAL;
+
+	slots = (size_t)setup.entries * setup.entry_size;
+	if (PAGE_SIZE + 2 * slots > FUSE_RING_MAX_SIZE)
+		return -EINVAL;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	mutex_init(&ring->lock);
+	ring->entries = setup.entries;
+	ring->entry_size = setup.entry_size;
+	ring->size = PAGE_ALIGN(PAGE_SIZE + 2 * slots);
+	ring->mem = vmalloc_user(ring->size);
+	err = -ENOMEM;
+	if (!ring->mem)
+		goto err_free;
+
+	ring->hdr = ring->mem;
+	ring->req_slots = ring->mem + PAGE_SIZE;
+	ring->cmp_slots = ring->req_slots + slots;
+	ring->hdr->entries = ring->entries;
+	ring->hdr->entry_size = ring->entry_size;
+	ring->hdr->req_offset = PAGE_SIZE;
+	ring->hdr->cmp_offset = PAGE_SIZE + slots;
+
+	if (setup.eventfd >= 0) {
+		ring->efd = eventfd_ctx_fdget(setup.eventfd);
+		if (IS_ERR(ring->efd)) {
+			err = PTR_ERR(ring->efd);
+			ring->efd = NULL;
+			goto err_free;
+		}
+	}
+
+	err = -EBUSY;
+	if (cmpxchg(&fud->ring, NULL, ring))
+		goto err_free;
+
+	/* One notifier per queue; further rings on it have to poll */
+	if (ring->efd) {
+		spin_lock(&fiq->waitq.lock);
+		if (!fiq->ring_efd) {
+			fiq->ring_efd = ring->efd;
+			ring->efd_fiq = fiq;
+		}
+		spin_unlock(&fiq->waitq.lock);
+	}
+
+	return 0;
+
+ err_free:
+	if (ring->efd)
+		eventfd_ctx_put(ring->efd);
+	vfree(ring->mem);
+	kfree(ring);
+	return err;
+}
+
+/* Called on device release, when the ring can no longer be mapped */
+static void fuse_ring_free(struct fuse_dev *fud)
+{
+	struct fuse_ring *ring = fud->ring;
+	struct fuse_iqueue *fiq = ring->efd_fiq;
+
+	if (fiq) {
+		spin_lock(&fiq->waitq.lock);
+		fiq->ring_efd = NULL;
+		spin_unlock(&fiq->waitq.lock);
+	}
+	if (ring->efd)
+		eventfd_ctx_put(ring->efd);
+	vfree(ring->mem);
+	kfree(ring);
+	fud->ring = NULL;
+}
+
+static int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_ring *ring;
+
+	if (!fud)
+		return -EPERM;
+
+	ring = READ_ONCE(fud->ring);
+	if (!ring)
+		return -ENODEV;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != ring->size)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->mem, 0);
+}
+
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
@@ -2095,7 +2649,7 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return POLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = READ_ONCE(fud->iq) ?: &fud->fc->iq;
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2140,6 +2694,28 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/* Disconnect the per-CPU input queues, moving their requests to to_end */
+static void abort_cpu_iqs(struct fuse_conn *fc, struct list_head *to_end)
+{
+	struct fuse_req *req;
+	int cpu;
+
+	if (!fc->cpu_iqs)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *fiq = &fc->cpu_iqs[cpu];
+
+		spin_lock(&fiq->waitq.lock);
+		fiq->connected = 0;
+		list_for_each_entry(req, &fiq->pending, list)
+			clear_bit(FR_PENDING, &req->flags);
+		list_splice_tail_init(&fiq->pending, to_end);
+		wake_up_all_locked(&fiq->waitq);
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
 /*
  * Abort all requests.
  *
@@ -2204,6 +2780,7 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 			kfree(dequeue_forget(fiq, 1, NULL));
 		wake_up_all_locked(&fiq->waitq);
 		spin_unlock(&fiq->waitq.lock);
+		abort_cpu_iqs(fc, &to_end2);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
@@ -2228,6 +2805,84 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Drop a device from a per-CPU queue. If it was the last one reading from
+ * that queue, hand its pending requests over to the main queue so they
+ * don't get stranded. Once the main queue is disconnected they are left
+ * for abort_cpu_iqs() to end instead. Readers still sleeping on the queue
+ * are woken so that a device moved to the main queue notices.
+ */
+static void fuse_iq_drop_dev(struct fuse_conn *fc, struct fuse_iqueue *fiq)
+{
+	struct fuse_iqueue *main_fiq = &fc->iq;
+	struct fuse_req *req;
+
+	spin_lock(&fiq->waitq.lock);
+	if (--fiq->nr_devs == 0 && !list_empty(&fiq->pending)) {
+		spin_lock_nested(&main_fiq->waitq.lock, SINGLE_DEPTH_NESTING);
+		if (main_fiq->connected) {
+			list_for_each_entry(req, &fiq->pending, list)
+				req->fiq = main_fiq;
+			list_splice_tail_init(&fiq->pending,
+					      &main_fiq->pending);
+			wake_up_locked(&main_fiq->waitq);
+		}
+		spin_unlock(&main_fiq->waitq.lock);
+		kill_fasync(&main_fiq->fasync, SIGIO, POLL_IN);
+	}
+	wake_up_all_locked(&fiq->waitq);
+	spin_unlock(&fiq->waitq.lock);
+}
+
+static void fuse_dev_unbind_queue(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq;
+
+	spin_lock(&fc->lock);
+	fiq = fud->iq;
+	if (fiq) {
+		WRITE_ONCE(fud->iq, NULL);
+		fc->nr_unbound_devs++;
+	}
+	spin_unlock(&fc->lock);
+
+	if (fiq)
+		fuse_iq_drop_dev(fc, fiq);
+}
+
+/*
+ * Forgets, interrupts and requests from CPUs without bound devices are only
+ * queued on the main queue. If the device being released is the last one
+ * reading it, move a bound device over, preferably one without a ring
+ * whose eventfd stays with its per-CPU queue.
+ */
+static void fuse_dev_keep_main_queue(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_dev *other, *pick = NULL;
+	struct fuse_iqueue *fiq = NULL;
+
+	spin_lock(&fc->lock);
+	if (!fud->iq && fc->nr_unbound_devs == 1) {
+		list_for_each_entry(other, &fc->devices, entry) {
+			if (!other->iq)
+				continue;
+			if (!pick || (pick->ring && !other->ring))
+				pick = other;
+		}
+	}
+	if (pick) {
+		fiq = pick->iq;
+		WRITE_ONCE(pick->iq, NULL);
+		fc->nr_unbound_devs++;
+	}
+	spin_unlock(&fc->lock);
+
+	if (fiq)
+		fuse_iq_drop_dev(fc, fiq);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2244,6 +2899,11 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		end_requests(fc, &to_end);
 
+		if (fud->ring)
+			fuse_ring_free(fud);
+		fuse_dev_unbind_queue(fud);
+		fuse_dev_keep_main_queue(fud);
+
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2283,11 +2943,72 @@ static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 	return 0;
 }
 
+/*
+ * Make the device read from the given CPU's input queue, so that requests
+ * submitted on that CPU are handled by the threads reading this device
+ * without touching the main queue. The first bind allocates the per-CPU
+ * queues. At least one device must stay unbound to serve the main queue.
+ */
+static int fuse_dev_bind_queue(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iqs;
+	int res = 0;
+	int i;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	if (!READ_ONCE(fc->cpu_iqs)) {
+		iqs = kcalloc(nr_cpu_ids, sizeof(*iqs), GFP_KERNEL);
+		if (!iqs)
+			return -ENOMEM;
+
+		for (i = 0; i < nr_cpu_ids; i++) {
+			fuse_iqueue_init(&iqs[i]);
+			/* Keep unique IDs disjoint from the other queues */
+			iqs[i].reqctr = (u64)(i + 1) << 48;
+		}
+
+		spin_lock(&fc->lock);
+		if (!fc->cpu_iqs) {
+			smp_store_release(&fc->cpu_iqs, iqs);
+			iqs = NULL;
+		}
+		spin_unlock(&fc->lock);
+		kfree(iqs);
+	}
+
+	spin_lock(&fc->lock);
+	if (!fc->connected) {
+		res = -ENOTCONN;
+	} else if (fud->iq || fud->ring) {
+		/* A ring notifies and fills from the queue it was set up on */
+		res = -EBUSY;
+	} else if (fc->nr_unbound_devs <= 1) {
+		/* Nothing would be left to read forgets and interrupts */
+		res = -EBUSY;
+	} else {
+		struct fuse_iqueue *fiq = &fc->cpu_iqs[cpu];
+
+		spin_lock(&fiq->waitq.lock);
+		fiq->nr_devs++;
+		spin_unlock(&fiq->waitq.lock);
+		WRITE_ONCE(fud->iq, fiq);
+		fc->nr_unbound_devs--;
+	}
+	spin_unlock(&fc->lock);
+
+	return res;
+}
+
 static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
 	int res;
 	int oldfd;
+	u32 cpu;
+	u32 flags;
 	struct fuse_dev *fud = NULL;
 
 	switch (cmd) {
@@ -2316,6 +3037,31 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			}
 		}
 		break;
+	case FUSE_DEV_IOC_BIND_QUEUE:
+		res = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *)arg)) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud)
+				res = fuse_dev_bind_queue(fud, cpu);
+		}
+		break;
+	case FUSE_DEV_IOC_RING_SETUP:
+		res = -EINVAL;
+		fud = fuse_get_dev(file);
+		if (fud)
+			res = fuse_ring_setup(fud,
+				(struct fuse_ring_setup __user *)arg);
+		break;
+	case FUSE_DEV_IOC_RING_ENTER:
+		res = -EFAULT;
+		if (!get_user(flags, (__u32 __user *)arg)) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud)
+				res = fuse_ring_enter(fud, flags);
+		}
+		break;
 	case FUSE_DEV_IOC_PASSTHROUGH_OPEN:
 		res = -EFAULT;
 		if (!get_user(oldfd, (__u32 __user *)arg)) {
@@ -2343,6 +3089,7 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.mmap		= fuse_dev_mmap,
 	.unlocked_ioctl = fuse_dev_ioctl,
 	.compat_ioctl   = fuse_dev_ioctl,
 };
@@ -2363,12 +3110,27 @@ int __init fuse_dev_init(void)
 	if (!fuse_req_cachep)
 		goto out;
 
+	fuse_page_array_cachep = kmem_cache_create("fuse_page_array",
+						   FUSE_PAGE_ARRAY_SIZE,
+						   0, 0, NULL);
+	if (!fuse_page_array_cachep)
+		goto out_cache_clean;
+
+	fuse_page_array_pool = mempool_create_slab_pool(FUSE_PAGE_ARRAY_RESERVE,
+							fuse_page_array_cachep);
+	if (!fuse_page_array_pool)
+		goto out_array_cache_clean;
+
 	err = misc_register(&fuse_miscdevice);
 	if (err)
-		goto out_cache_clean;
+		goto out_pool_clean;
 
 	return 0;
 
+ out_pool_clean:
+	mempool_destroy(fuse_page_array_pool);
+ out_array_cache_clean:
+	kmem_cache_destroy(fuse_page_array_cachep);
  out_cache_clean:
 	kmem_cache_destroy(fuse_req_cachep);
  out:
@@ -2378,5 +3140,7 @@ int __init fuse_dev_init(void)
 void fuse_dev_cleanup(void)
 {
 	misc_deregister(&fuse_miscdevice);
+	mempool_destroy(fuse_page_array_pool);
+	kmem_cache_destroy(fuse_page_array_cachep);
 	kmem_cache_destroy(fuse_req_cachep);
 }
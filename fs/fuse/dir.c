@@ -999,6 +999,29 @@ static int fuse_do_getattr(struct inode *inode, struct kstat *stat,
 	return err;
 }
 
+/*
+ * Refresh attributes from the lower inode pinned by FOPEN_PASSTHROUGH_ATTR.
+ * They are cheap to fetch, so they are never cached beyond this call.
+ */
+static int fuse_passthrough_do_getattr(struct inode *inode, struct kstat *stat)
+{
+	int err;
+	u64 attr_version;
+	struct fuse_attr attr;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+
+	attr_version = fuse_get_attr_version(fc);
+	err = fuse_passthrough_getattr(inode, &attr);
+	if (err)
+		return err;
+
+	fuse_change_attributes(inode, &attr, get_jiffies_64(), attr_version);
+	if (stat)
+		fuse_fillattr(inode, &attr, stat);
+
+	return 0;
+}
+
 static int fuse_update_get_attr(struct inode *inode, struct file *file,
 				struct kstat *stat)
 {
@@ -1007,7 +1030,11 @@ static int fuse_update_get_attr(struct inode *inode, struct file *file,
 
 	if (time_before64(fi->i_time, get_jiffies_64())) {
 		forget_all_cached_acls(inode);
-		err = fuse_do_getattr(inode, stat, file);
+		err = -ENOENT;
+		if (fi->passthrough_path.dentry)
+			err = fuse_passthrough_do_getattr(inode, stat);
+		if (err)
+			err = fuse_do_getattr(inode, stat, file);
 	} else if (stat) {
 		generic_fillattr(inode, stat);
 		stat->mode = fi->orig_i_mode;
@@ -1412,10 +1439,14 @@ static int fuse_readdir(struct file *file, struct dir_context *ctx)
 	struct fuse_req *req;
 	u64 attr_version = 0;
 	bool locked;
+	struct fuse_file *ff = file->private_data;
 
 	if (fuse_is_bad(inode))
 		return -EIO;
 
+	if (ff->passthrough.filp)
+		return fuse_passthrough_readdir(file, ctx);
+
 	req = fuse_get_req(fc, 1);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
@@ -27,8 +27,11 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single read request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Upper bound for the max_pages negotiated at FUSE_INIT (4MiB with 4k pages) */
+#define FUSE_MAX_MAX_PAGES 1024
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -107,6 +110,13 @@ struct fuse_inode {
 
 	/** Lock for serializing lookup and readdir for back compatibility*/
 	struct mutex mutex;
+
+	/** Lower path getattr is served from, see FOPEN_PASSTHROUGH_ATTR.
+	    Protected by fc->lock */
+	struct path passthrough_path;
+
+	/** Credentials for stat on passthrough_path */
+	const struct cred *passthrough_cred;
 };
 
 /** FUSE inode state bits */
@@ -373,6 +383,9 @@ struct fuse_req {
 	/** size of the 'pages' array */
 	unsigned max_pages;
 
+	/** 'pages' came from the fallback page array mempool */
+	bool pages_from_pool;
+
 	/** inline page vector */
 	struct page *inline_pages[FUSE_REQ_INLINE_PAGES];
 
@@ -402,6 +415,9 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Input queue the request was queued on, under its waitq.lock */
+	struct fuse_iqueue *fiq;
 };
 
 struct fuse_iqueue {
@@ -429,7 +445,13 @@ struct fuse_iqueue {
 
 	/** O_ASYNC requests */
 	struct fasync_struct *fasync;
-};
+
+	/** Number of devices bound to this per-CPU queue */
+	unsigned int nr_devs;
+
+	/** Signalled on every queued request if a device has a ring */
+	struct eventfd_ctx *ring_efd;
+} ____cacheline_aligned_in_smp;
 
 struct fuse_pqueue {
 	/** Connection established */
@@ -445,6 +467,37 @@ struct fuse_pqueue {
 	struct list_head io;
 };
 
+/**
+ * Shared memory request/reply ring of a fuse device
+ *
+ * The mapping starts with a struct fuse_ring_header page, followed by the
+ * request slots and then the completion slots. Slots carry the same bytes a
+ * read() or write() on the device would.
+ */
+struct fuse_ring {
+	/** Serializes FUSE_DEV_IOC_RING_ENTER callers */
+	struct mutex lock;
+
+	/** vmalloc_user() area mapped by the daemon */
+	void *mem;
+	size_t size;
+
+	struct fuse_ring_header *hdr;
+	u8 *req_slots;
+	u8 *cmp_slots;
+
+	u32 entries;
+	u32 entry_size;
+
+	/** Kernel copies of the indexes the kernel owns */
+	u32 req_tail;
+	u32 cmp_head;
+
+	/** Queue whose ring_efd this ring installed, if any */
+	struct fuse_iqueue *efd_fiq;
+	struct eventfd_ctx *efd;
+};
+
 /**
  * Fuse device instance
  */
@@ -457,6 +510,12 @@ struct fuse_dev {
 
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Per-CPU input queue this device reads from, NULL for fc->iq */
+	struct fuse_iqueue *iq;
+
+	/** Shared memory ring, set up with FUSE_DEV_IOC_RING_SETUP */
+	struct fuse_ring *ring;
 };
 
 /**
@@ -493,9 +552,23 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages that can be used in a single request */
+	unsigned int max_pages;
+
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/**
+	 * Per-CPU input queues, indexed by CPU. Allocated when the first
+	 * device is bound to a CPU with FUSE_DEV_IOC_BIND_QUEUE. Requests
+	 * submitted on a CPU whose queue has bound devices go there,
+	 * everything else (including forgets and interrupts) uses iq.
+	 */
+	struct fuse_iqueue *cpu_iqs;
+
+	/** Number of devices reading from iq, protected by lock */
+	unsigned int nr_unbound_devs;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -849,6 +922,12 @@ struct fuse_req *fuse_request_alloc(unsigned npages);
 
 struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
+/**
+ * Grow the page array of a request that is still being filled
+ */
+bool fuse_req_realloc_pages(struct fuse_conn *fc, struct fuse_req *req,
+			    gfp_t flags);
+
 /**
  * Free a request
  */
@@ -920,6 +999,11 @@ struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
  */
 void fuse_conn_init(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue
+ */
+void fuse_iqueue_init(struct fuse_iqueue *fiq);
+
 /**
  * Release reference to fuse_conn
  */
@@ -1038,5 +1122,9 @@ void fuse_passthrough_release(struct fuse_passthrough *passthrough);
 ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
 ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx);
+int fuse_passthrough_getattr(struct inode *inode, struct fuse_attr *attr);
+void fuse_passthrough_finish_open(struct inode *inode, struct fuse_file *ff);
+void fuse_passthrough_drop_attr(struct inode *inode);
 
 #endif /* _FS_FUSE_I_H */
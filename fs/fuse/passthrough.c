@@ -5,6 +5,7 @@
 #include <linux/file.h>
 #include <linux/fuse.h>
 #include <linux/idr.h>
+#include <linux/namei.h>
 #include <linux/uio.h>
 
 #define PASSTHROUGH_IOCB_MASK                                                  \
@@ -178,6 +179,148 @@ ssize_t fuse_passthrough_write_iter(struct kiocb *iocb_fuse,
 	return ret;
 }
 
+int fuse_passthrough_readdir(struct file *file, struct dir_context *ctx)
+{
+	int ret;
+	const struct cred *old_cred;
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough.filp;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	/*
+	 * iterate_dir() restarts from the lower file position, so carry over
+	 * any seek done on the fuse directory.  Going through llseek lets the
+	 * lower fs revalidate its cookies (e.g. ext4 htree hashes).
+	 */
+	if (passthrough_filp->f_pos != ctx->pos) {
+		loff_t pos = vfs_llseek(passthrough_filp, ctx->pos, SEEK_SET);
+
+		if (pos < 0) {
+			ret = pos;
+			goto out;
+		}
+	}
+	ret = iterate_dir(passthrough_filp, ctx);
+out:
+	revert_creds(old_cred);
+
+	fuse_file_accessed(file, passthrough_filp);
+
+	return ret;
+}
+
+/*
+ * Fill @attr for a getattr served from the lower inode.  Size, blocks and
+ * times come from the lower fs; identity and permission fields (ino, mode,
+ * owner, link count) stay as the daemon last reported them, since the daemon
+ * may present a different view of ownership than the backing store.
+ */
+int fuse_passthrough_getattr(struct inode *inode, struct fuse_attr *attr)
+{
+	int err;
+	struct kstat stat;
+	struct path lower;
+	const struct cred *cred;
+	const struct cred *old_cred;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	spin_lock(&fc->lock);
+	lower = fi->passthrough_path;
+	if (!lower.dentry) {
+		spin_unlock(&fc->lock);
+		return -ENOENT;
+	}
+	path_get(&lower);
+	cred = get_cred(fi->passthrough_cred);
+	spin_unlock(&fc->lock);
+
+	old_cred = override_creds(cred);
+	err = vfs_getattr(&lower, &stat, STATX_BASIC_STATS,
+			  AT_STATX_SYNC_AS_STAT);
+	revert_creds(old_cred);
+	put_cred(cred);
+	path_put(&lower);
+	if (err)
+		return err;
+
+	if ((stat.mode ^ inode->i_mode) & S_IFMT)
+		return -ESTALE;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = fi->orig_ino;
+	attr->mode = fi->orig_i_mode;
+	attr->nlink = inode->i_nlink;
+	attr->uid = from_kuid(&init_user_ns, inode->i_uid);
+	attr->gid = from_kgid(&init_user_ns, inode->i_gid);
+	attr->rdev = new_encode_dev(inode->i_rdev);
+	attr->size = stat.size;
+	attr->blocks = stat.blocks;
+	attr->blksize = stat.blksize;
+	attr->atime = stat.atime.tv_sec;
+	attr->atimensec = stat.atime.tv_nsec;
+	attr->mtime = stat.mtime.tv_sec;
+	attr->mtimensec = stat.mtime.tv_nsec;
+	attr->ctime = stat.ctime.tv_sec;
+	attr->ctimensec = stat.ctime.tv_nsec;
+
+	return 0;
+}
+
+/*
+ * Called once the open has been committed.  Drops a lower file whose type
+ * does not match the fuse inode, and, for FOPEN_PASSTHROUGH_ATTR, pins the
+ * lower path on the inode so later getattr calls can be answered without
+ * the daemon.  The first open to request it wins.
+ */
+void fuse_passthrough_finish_open(struct inode *inode, struct fuse_file *ff)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct file *passthrough_filp = ff->passthrough.filp;
+
+	if (!passthrough_filp)
+		return;
+
+	if ((file_inode(passthrough_filp)->i_mode ^ inode->i_mode) & S_IFMT) {
+		pr_warn_ratelimited("FUSE: passthrough file type mismatch\n");
+		fuse_passthrough_release(&ff->passthrough);
+		return;
+	}
+
+	if (!(ff->open_flags & FOPEN_PASSTHROUGH_ATTR))
+		return;
+
+	spin_lock(&fc->lock);
+	if (!fi->passthrough_path.dentry) {
+		fi->passthrough_path = passthrough_filp->f_path;
+		path_get(&fi->passthrough_path);
+		fi->passthrough_cred = get_cred(ff->passthrough.cred);
+	}
+	spin_unlock(&fc->lock);
+}
+
+void fuse_passthrough_drop_attr(struct inode *inode)
+{
+	struct path lower;
+	const struct cred *cred;
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	spin_lock(&fc->lock);
+	lower = fi->passthrough_path;
+	cred = fi->passthrough_cred;
+	fi->passthrough_path.mnt = NULL;
+	fi->passthrough_path.dentry = NULL;
+	fi->passthrough_cred = NULL;
+	spin_unlock(&fc->lock);
+
+	if (lower.dentry) {
+		path_put(&lower);
+		put_cred(cred);
+	}
+}
+
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	int ret;
@@ -225,8 +368,15 @@ int fuse_passthrough_open(struct fuse_dev *fud, u32 lower_fd)
 		return -EBADF;
 	}
 
-	if (!passthrough_filp->f_op->read_iter ||
-	    !passthrough_filp->f_op->write_iter) {
+	if (S_ISDIR(file_inode(passthrough_filp)->i_mode)) {
+		if (!passthrough_filp->f_op->iterate &&
+		    !passthrough_filp->f_op->iterate_shared) {
+			pr_err("FUSE: passthrough directory misses iterate.\n");
+			res = -EBADF;
+			goto err_free_file;
+		}
+	} else if (!passthrough_filp->f_op->read_iter ||
+		   !passthrough_filp->f_op->write_iter) {
 		pr_err("FUSE: passthrough file misses file operations.\n");
 		res = -EBADF;
 		goto err_free_file;
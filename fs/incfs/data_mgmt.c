@@ -9,14 +9,40 @@
 #include <linux/lz4.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
+#include <linux/percpu.h>
+#include <linux/sched/mm.h>
 #include <linux/slab.h>
 #include <linux/types.h>
+#include <linux/vmalloc.h>
 #include <linux/workqueue.h>
+#include <linux/zstd.h>
 
 #include "data_mgmt.h"
 #include "format.h"
 #include "integrity.h"
 
+/*
+ * Present data blocks never move or change, so once a block's blockmap entry
+ * has been seen it can be cached for the lifetime of the data_file. Each
+ * entry is packed into a single u64 so that it can be read without locks;
+ * zero means the block isn't cached (and may be missing). The top two bits
+ * hold the block's enum incfs_compression_alg.
+ */
+#define BMC_CHUNK_SHIFT 9
+#define BMC_CHUNK_ENTRIES (1 << BMC_CHUNK_SHIFT)
+#define BMC_OFFSET_MASK (BIT_ULL(48) - 1)
+#define BMC_SIZE_SHIFT 48
+#define BMC_SIZE_MASK 0x3fff
+#define BMC_ALG_SHIFT 62
+#define BMC_ALG_MASK 0x3
+
+struct blockmap_cache_chunk {
+	atomic64_t entries[BMC_CHUNK_ENTRIES];
+};
+
+static void hash_cache_drop(struct data_file *df);
+static void hash_cache_free(struct data_file *df);
+
 static void log_wake_up_all(struct work_struct *work)
 {
 	struct delayed_work *dw = container_of(work, struct delayed_work, work);
@@ -173,6 +199,12 @@ struct data_file *incfs_open_data_file(struct mount_info *mi, struct file *bf)
 	if (size > 0)
 		df->df_data_block_count = get_blocks_count_for_size(size);
 
+	if (df->df_data_block_count > 0)
+		df->df_bmc_chunks = kcalloc(DIV_ROUND_UP(df->df_data_block_count,
+							 BMC_CHUNK_ENTRIES),
+					    sizeof(*df->df_bmc_chunks),
+					    GFP_NOFS | __GFP_NOWARN);
+
 	md_records = incfs_scan_metadata_chain(df);
 	if (md_records < 0)
 		error = md_records;
@@ -195,9 +227,17 @@ void incfs_free_data_file(struct data_file *df)
 	if (!df)
 		return;
 
+	if (df->df_hash_tree)
+		hash_cache_free(df);
 	incfs_free_mtree(df->df_hash_tree);
 	for (i = 0; i < ARRAY_SIZE(df->df_segments); i++)
 		data_file_segment_destroy(&df->df_segments[i]);
+	if (df->df_bmc_chunks) {
+		for (i = 0; i < DIV_ROUND_UP(df->df_data_block_count,
+					     BMC_CHUNK_ENTRIES); i++)
+			kfree(df->df_bmc_chunks[i]);
+		kfree(df->df_bmc_chunks);
+	}
 	incfs_free_bfc(df->df_backing_file_context);
 	kfree(df->df_signature);
 	kfree(df);
@@ -221,12 +261,31 @@ int make_inode_ready_for_data_ops(struct mount_info *mi,
 			else
 				node->n_file = df;
 		}
+		if (!err)
+			node->n_file->df_open_count++;
 	} else
 		err = -EBADF;
 	inode_unlock(inode);
 	return err;
 }
 
+void release_inode_data_ops(struct inode *inode)
+{
+	struct inode_info *node = get_incfs_node(inode);
+	struct data_file *df;
+
+	inode_lock(inode);
+	df = node->n_file;
+	/*
+	 * Pinned hash pages would keep the inode's page cache, and with it the
+	 * inode, from ever being reclaimed. With no file open nothing can be
+	 * reading through the cache.
+	 */
+	if (df && !WARN_ON(df->df_open_count <= 0) && !--df->df_open_count)
+		hash_cache_drop(df);
+	inode_unlock(inode);
+}
+
 struct dir_file *incfs_open_dir_file(struct mount_info *mi, struct file *bf)
 {
 	struct dir_file *dir = NULL;
@@ -252,16 +311,166 @@ void incfs_free_dir_file(struct dir_file *dir)
 	kfree(dir);
 }
 
-static ssize_t decompress(struct mem_range src, struct mem_range dst)
+/*
+ * zstd decompression contexts, one per CPU. They are allocated the first
+ * time a zstd block is read so that mounts without zstd data don't pay for
+ * them, and live until the module is unloaded.
+ */
+struct zstd_workspace {
+	void *mem;
+	ZSTD_DCtx *dctx;
+};
+
+static DEFINE_PER_CPU(struct zstd_workspace, zstd_workspaces);
+static DEFINE_MUTEX(zstd_workspaces_mutex);
+static bool zstd_workspaces_ready;
+
+static int zstd_workspaces_init(void)
 {
-	int result = LZ4_decompress_safe(src.data, dst.data, src.len, dst.len);
+	size_t size;
+	unsigned int nofs_flags;
+	int cpu;
+	int error = 0;
 
-	if (result < 0)
+	if (smp_load_acquire(&zstd_workspaces_ready))
+		return 0;
+
+	mutex_lock(&zstd_workspaces_mutex);
+	if (zstd_workspaces_ready)
+		goto out;
+
+	size = ZSTD_DCtxWorkspaceBound();
+	nofs_flags = memalloc_nofs_save();
+	for_each_possible_cpu(cpu) {
+		struct zstd_workspace *ws = per_cpu_ptr(&zstd_workspaces, cpu);
+
+		if (ws->dctx)
+			continue;
+
+		if (!ws->mem)
+			ws->mem = vmalloc(size);
+		if (!ws->mem) {
+			error = -ENOMEM;
+			break;
+		}
+
+		ws->dctx = ZSTD_initDCtx(ws->mem, size);
+		if (!ws->dctx) {
+			error = -EINVAL;
+			break;
+		}
+	}
+	memalloc_nofs_restore(nofs_flags);
+
+	if (!error)
+		smp_store_release(&zstd_workspaces_ready, true);
+out:
+	mutex_unlock(&zstd_workspaces_mutex);
+	return error;
+}
+
+void incfs_free_zstd_workspaces(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct zstd_workspace *ws = per_cpu_ptr(&zstd_workspaces, cpu);
+
+		vfree(ws->mem);
+		ws->mem = NULL;
+		ws->dctx = NULL;
+	}
+	zstd_workspaces_ready = false;
+}
+
+static ssize_t decompress_zstd(struct mem_range src, struct mem_range dst)
+{
+	struct zstd_workspace *ws;
+	unsigned long long content_size;
+	size_t result;
+	int error;
+
+	/*
+	 * Providers normally record the uncompressed size in the frame
+	 * header. Use it to reject frames that can't fit in a block before
+	 * decoding anything, and to skip the decoder for empty frames.
+	 */
+	content_size = ZSTD_getFrameContentSize(src.data, src.len);
+	if (content_size == ZSTD_CONTENTSIZE_ERROR)
+		return -EBADMSG;
+	if (content_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+		if (content_size > dst.len)
+			return -EBADMSG;
+		if (content_size == 0)
+			return 0;
+		dst.len = content_size;
+	}
+
+	error = zstd_workspaces_init();
+	if (error)
+		return error;
+
+	ws = get_cpu_ptr(&zstd_workspaces);
+	result = ZSTD_decompressDCtx(ws->dctx, dst.data, dst.len, src.data,
+				     src.len);
+	put_cpu_ptr(&zstd_workspaces);
+
+	if (ZSTD_isError(result))
 		return -EBADMSG;
 
 	return result;
 }
 
+static ssize_t decompress(struct mem_range src, struct mem_range dst,
+			  enum incfs_compression_alg alg)
+{
+	int result;
+
+	switch (alg) {
+	case COMPRESSION_LZ4:
+		result = LZ4_decompress_safe(src.data, dst.data, src.len,
+					     dst.len);
+		if (result < 0)
+			return -EBADMSG;
+		return result;
+
+	case COMPRESSION_ZSTD:
+		return decompress_zstd(src, dst);
+
+	default:
+		return -EBADMSG;
+	}
+}
+
+/*
+ * Decodes blocks whose stored data lies in src, which holds the backing file
+ * bytes starting at offset base. Returns the number of leading blocks
+ * successfully decoded.
+ */
+static int decompress_blocks(u8 *src, loff_t base,
+			     struct data_file_block *blocks,
+			     struct mem_range *dst, ssize_t *res, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct data_file_block *block = &blocks[i];
+		u8 *data = src + (block->db_backing_file_data_offset - base);
+
+		if (block->db_comp_alg == COMPRESSION_NONE) {
+			res[i] = min(dst[i].len, block->db_stored_size);
+			memcpy(dst[i].data, data, res[i]);
+		} else {
+			res[i] = decompress(range(data, block->db_stored_size),
+					    dst[i], block->db_comp_alg);
+			if (res[i] < 0)
+				break;
+		}
+	}
+
+	return i;
+}
+
 static void log_read_one_record(struct read_log *rl, struct read_log_state *rs)
 {
 	union log_record *record =
@@ -388,6 +597,82 @@ static void log_block_read(struct mount_info *mi, incfs_uuid_t *id,
 	schedule_delayed_work(&log->ml_wakeup_work, msecs_to_jiffies(16));
 }
 
+/*
+ * Verified hash tree blocks are pinned in df_hash_pages while the file is
+ * open, indexed by block number within the hash tree area. A non-NULL
+ * slot both marks the block as verified and holds its contents, so once a
+ * leaf hash block has been verified, validating any data block under it is a
+ * single hash.
+ */
+static DEFINE_PER_CPU(unsigned long, hash_cache_hits);
+static DEFINE_PER_CPU(unsigned long, hash_cache_misses);
+
+void incfs_get_hash_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+	int cpu;
+
+	*hits = 0;
+	*misses = 0;
+	for_each_possible_cpu(cpu) {
+		*hits += per_cpu(hash_cache_hits, cpu);
+		*misses += per_cpu(hash_cache_misses, cpu);
+	}
+}
+
+static struct page *hash_cache_get(struct data_file *df, loff_t offset)
+{
+	if (!df->df_hash_pages)
+		return NULL;
+
+	return READ_ONCE(
+		df->df_hash_pages[offset / INCFS_DATA_FILE_BLOCK_SIZE]);
+}
+
+static void hash_cache_set(struct data_file *df, loff_t offset,
+			   struct page *page)
+{
+	if (!df->df_hash_pages)
+		return;
+
+	get_page(page);
+	if (cmpxchg(&df->df_hash_pages[offset / INCFS_DATA_FILE_BLOCK_SIZE],
+		    NULL, page))
+		put_page(page);
+}
+
+static void hash_cache_read(struct page *page, size_t offset, u8 *digest,
+			    int digest_size)
+{
+	u8 *addr = kmap_atomic(page);
+
+	memcpy(digest, addr + offset, digest_size);
+	kunmap_atomic(addr);
+}
+
+static void hash_cache_drop(struct data_file *df)
+{
+	int i;
+
+	if (!df->df_hash_pages)
+		return;
+
+	for (i = 0; i < df->df_hash_tree->hash_tree_area_size /
+				INCFS_DATA_FILE_BLOCK_SIZE;
+	     i++) {
+		if (df->df_hash_pages[i]) {
+			put_page(df->df_hash_pages[i]);
+			df->df_hash_pages[i] = NULL;
+		}
+	}
+}
+
+static void hash_cache_free(struct data_file *df)
+{
+	hash_cache_drop(df);
+	kvfree(df->df_hash_pages);
+	df->df_hash_pages = NULL;
+}
+
 static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 			      int block_index, struct mem_range data, u8 *buf)
 {
@@ -396,6 +681,7 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 	u8 calculated_digest[INCFS_MAX_HASH_SIZE] = {};
 	struct mtree *tree = NULL;
 	struct incfs_df_signature *sig = NULL;
+	struct page *cached;
 	int digest_size;
 	int hash_block_index = block_index;
 	int lvl;
@@ -423,6 +709,17 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 		hash_block_index /= hash_per_block;
 	}
 
+	/* Fast path, the leaf hash block has already been verified */
+	cached = tree->depth > 0 ? hash_cache_get(df, hash_block_offset[0]) :
+				   NULL;
+	if (cached) {
+		this_cpu_inc(hash_cache_hits);
+		hash_cache_read(cached, hash_offset_in_block[0], stored_digest,
+				digest_size);
+		goto check_leaf;
+	}
+	this_cpu_inc(hash_cache_misses);
+
 	memcpy(stored_digest, tree->root_hash, digest_size);
 
 	file_pages = DIV_ROUND_UP(df->df_size, INCFS_DATA_FILE_BLOCK_SIZE);
@@ -430,15 +727,21 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 		pgoff_t hash_page =
 			file_pages +
 			hash_block_offset[lvl] / INCFS_DATA_FILE_BLOCK_SIZE;
-		struct page *page = find_get_page_flags(
-			f->f_inode->i_mapping, hash_page, FGP_ACCESSED);
+		struct page *page;
 
-		if (page && PageChecked(page)) {
-			u8 *addr = kmap_atomic(page);
+		cached = hash_cache_get(df, hash_block_offset[lvl]);
+		if (cached) {
+			hash_cache_read(cached, hash_offset_in_block[lvl],
+					stored_digest, digest_size);
+			continue;
+		}
 
-			memcpy(stored_digest, addr + hash_offset_in_block[lvl],
-			       digest_size);
-			kunmap_atomic(addr);
+		page = find_get_page_flags(f->f_inode->i_mapping, hash_page,
+					   FGP_ACCESSED);
+		if (page && PageChecked(page)) {
+			hash_cache_read(page, hash_offset_in_block[lvl],
+					stored_digest, digest_size);
+			hash_cache_set(df, hash_block_offset[lvl], page);
 			put_page(page);
 			continue;
 		}
@@ -485,11 +788,13 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 			memcpy(addr, buf, INCFS_DATA_FILE_BLOCK_SIZE);
 			kunmap_atomic(addr);
 			SetPageChecked(page);
+			hash_cache_set(df, hash_block_offset[lvl], page);
 			unlock_page(page);
 			put_page(page);
 		}
 	}
 
+check_leaf:
 	res = incfs_calc_digest(tree->alg, data,
 				range(calculated_digest, digest_size));
 	if (res)
@@ -528,9 +833,72 @@ static void convert_data_file_block(struct incfs_blockmap_entry *bme,
 	res_block->db_backing_file_data_offset |=
 		le32_to_cpu(bme->me_data_offset_lo);
 	res_block->db_stored_size = le16_to_cpu(bme->me_data_size);
-	res_block->db_comp_alg = (flags & INCFS_BLOCK_COMPRESSED_LZ4) ?
-					 COMPRESSION_LZ4 :
-					 COMPRESSION_NONE;
+	if (flags & INCFS_BLOCK_COMPRESSED_ZSTD)
+		res_block->db_comp_alg = COMPRESSION_ZSTD;
+	else if (flags & INCFS_BLOCK_COMPRESSED_LZ4)
+		res_block->db_comp_alg = COMPRESSION_LZ4;
+	else
+		res_block->db_comp_alg = COMPRESSION_NONE;
+}
+
+/* Lockless lookup of a cached present block */
+static bool blockmap_cache_get(struct data_file *df, int index,
+			       struct data_file_block *res_block)
+{
+	struct blockmap_cache_chunk *chunk;
+	u64 v;
+
+	if (!df->df_bmc_chunks || index < 0 ||
+	    index >= df->df_data_block_count)
+		return false;
+
+	chunk = smp_load_acquire(&df->df_bmc_chunks[index >> BMC_CHUNK_SHIFT]);
+	if (!chunk)
+		return false;
+
+	v = atomic64_read(&chunk->entries[index & (BMC_CHUNK_ENTRIES - 1)]);
+	if (!v)
+		return false;
+
+	res_block->db_backing_file_data_offset = v & BMC_OFFSET_MASK;
+	res_block->db_stored_size = (v >> BMC_SIZE_SHIFT) & BMC_SIZE_MASK;
+	res_block->db_comp_alg = (v >> BMC_ALG_SHIFT) & BMC_ALG_MASK;
+	return true;
+}
+
+static void blockmap_cache_set(struct data_file *df, int index,
+			       struct data_file_block *block)
+{
+	struct blockmap_cache_chunk *chunk, *old;
+	struct blockmap_cache_chunk **slot;
+	u64 v;
+
+	if (!df->df_bmc_chunks || index < 0 ||
+	    index >= df->df_data_block_count ||
+	    !is_data_block_present(block) ||
+	    block->db_backing_file_data_offset > BMC_OFFSET_MASK ||
+	    block->db_stored_size > BMC_SIZE_MASK ||
+	    block->db_comp_alg > BMC_ALG_MASK)
+		return;
+
+	slot = &df->df_bmc_chunks[index >> BMC_CHUNK_SHIFT];
+	chunk = smp_load_acquire(slot);
+	if (!chunk) {
+		chunk = kzalloc(sizeof(*chunk), GFP_NOFS | __GFP_NOWARN);
+		if (!chunk)
+			return;
+
+		old = cmpxchg(slot, NULL, chunk);
+		if (old) {
+			kfree(chunk);
+			chunk = old;
+		}
+	}
+
+	v = block->db_backing_file_data_offset |
+	    ((u64)block->db_stored_size << BMC_SIZE_SHIFT) |
+	    ((u64)block->db_comp_alg << BMC_ALG_SHIFT);
+	atomic64_set(&chunk->entries[index & (BMC_CHUNK_ENTRIES - 1)], v);
 }
 
 static int get_data_file_block(struct data_file *df, int index,
@@ -544,6 +912,9 @@ static int get_data_file_block(struct data_file *df, int index,
 	if (!df || !res_block)
 		return -EFAULT;
 
+	if (blockmap_cache_get(df, index, res_block))
+		return 0;
+
 	blockmap_off = df->df_blockmap_off;
 	bfc = df->df_backing_file_context;
 
@@ -555,6 +926,7 @@ static int get_data_file_block(struct data_file *df, int index,
 		return error;
 
 	convert_data_file_block(&bme, res_block);
+	blockmap_cache_set(df, index, res_block);
 	return 0;
 }
 
@@ -830,6 +1202,10 @@ static int wait_for_data_block(struct data_file *df, int block_index,
 	if (df->df_blockmap_off <= 0)
 		return -ENODATA;
 
+	/* Fast path: the block is present and its entry is cached */
+	if (blockmap_cache_get(df, block_index, res_block))
+		return 0;
+
 	segment = get_file_segment(df, block_index);
 	error = mutex_lock_interruptible(&segment->blockmap_mutex);
 	if (error)
@@ -949,7 +1325,8 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 		result = incfs_kread(bfc, tmp.data, bytes_to_read, pos);
 		if (result == bytes_to_read) {
 			result =
-				decompress(range(tmp.data, bytes_to_read), dst);
+				decompress(range(tmp.data, bytes_to_read), dst,
+					   block.db_comp_alg);
 			if (result < 0) {
 				const char *name =
 				    bfc->bc_file->f_path.dentry->d_name.name;
@@ -977,6 +1354,119 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 	return result;
 }
 
+/* Look up a block without waiting for it; false if it isn't present */
+static bool get_present_block(struct data_file *df, int index,
+			      struct data_file_block *block)
+{
+	struct data_file_segment *segment;
+	int error;
+
+	if (blockmap_cache_get(df, index, block))
+		return true;
+
+	segment = get_file_segment(df, index);
+	if (mutex_lock_interruptible(&segment->blockmap_mutex))
+		return false;
+	error = get_data_file_block(df, index, block);
+	mutex_unlock(&segment->blockmap_mutex);
+
+	return !error && is_data_block_present(block);
+}
+
+/*
+ * Read up to nr consecutive blocks starting at first_index into dst, which
+ * must be sized the way incfs_read_data_file_block() expects. Only the
+ * leading run of blocks that are present and stored back to back in the
+ * backing file is read, with a single backing read; nothing here waits for
+ * missing data.
+ *
+ * On return dst[i].len holds the number of bytes read for each block done.
+ * Returns the number of leading blocks read and validated, which may be 0,
+ * the caller is expected to fall back to incfs_read_data_file_block() for
+ * the rest.
+ */
+int incfs_read_data_file_blocks(struct file *f, int first_index,
+				struct mem_range *dst, int nr)
+{
+	struct data_file_block blocks[INCFS_READ_BATCH_MAX];
+	ssize_t res[INCFS_READ_BATCH_MAX];
+	struct data_file *df = get_incfs_data_file(f);
+	struct backing_file_context *bfc;
+	loff_t base;
+	size_t total;
+	size_t buf_size;
+	ssize_t result;
+	u8 *buf;
+	int i;
+
+	if (!df || !dst)
+		return -EFAULT;
+
+	if (first_index < 0 || df->df_blockmap_off <= 0)
+		return 0;
+
+	nr = min3(nr, INCFS_READ_BATCH_MAX,
+		  df->df_data_block_count - first_index);
+
+	for (i = 0; i < nr; i++) {
+		if (!get_present_block(df, first_index + i, &blocks[i]))
+			break;
+
+		if (blocks[i].db_stored_size > INCFS_DATA_FILE_BLOCK_SIZE)
+			break;
+
+		if (i > 0 && blocks[i].db_backing_file_data_offset !=
+				     blocks[i - 1].db_backing_file_data_offset +
+					     blocks[i - 1].db_stored_size)
+			break;
+	}
+	nr = i;
+	if (nr <= 0)
+		return 0;
+
+	base = blocks[0].db_backing_file_data_offset;
+	total = blocks[nr - 1].db_backing_file_data_offset +
+		blocks[nr - 1].db_stored_size - base;
+
+	/* The buffer doubles as scratch space for hash tree validation */
+	buf_size = max_t(size_t, total, INCFS_DATA_FILE_BLOCK_SIZE);
+	buf = (u8 *)__get_free_pages(GFP_NOFS | __GFP_NORETRY | __GFP_NOWARN,
+				     get_order(buf_size));
+	if (!buf)
+		return 0;
+
+	bfc = df->df_backing_file_context;
+	result = incfs_kread(bfc, buf, total, base);
+	if (result < 0) {
+		nr = 0;
+		goto out;
+	}
+
+	/* Short read, keep only the blocks that were read in full */
+	while (nr > 0 && blocks[nr - 1].db_backing_file_data_offset +
+				 blocks[nr - 1].db_stored_size - base > result)
+		nr--;
+
+	nr = decompress_blocks(buf, base, blocks, dst, res, nr);
+	/*
+	 * Once the first block of a leaf hash block has been validated its
+	 * parents are cached, so the rest of the run costs one hash each.
+	 */
+	for (i = 0; i < nr; i++)
+		if (validate_hash_tree(bfc, f, first_index + i, dst[i], buf))
+			break;
+	nr = i;
+
+	for (i = 0; i < nr; i++) {
+		dst[i].len = res[i];
+		log_block_read(df->df_mount_info, &df->df_id, first_index + i);
+	}
+
+out:
+	free_pages((unsigned long)buf, get_order(buf_size));
+	return nr;
+}
+
 int incfs_process_new_data_block(struct data_file *df,
 				 struct incfs_fill_block *block, u8 *data)
 {
@@ -984,6 +1474,7 @@ int incfs_process_new_data_block(struct data_file *df,
 	struct backing_file_context *bfc = NULL;
 	struct data_file_segment *segment = NULL;
 	struct data_file_block existing_block = {};
+	struct incfs_blockmap_entry bme = {};
 	u16 flags = 0;
 	int error = 0;
 
@@ -999,8 +1490,18 @@ int incfs_process_new_data_block(struct data_file *df,
 	segment = get_file_segment(df, block->block_index);
 	if (!segment)
 		return -EFAULT;
-	if (block->compression == COMPRESSION_LZ4)
+	switch (block->compression) {
+	case COMPRESSION_NONE:
+		break;
+	case COMPRESSION_LZ4:
 		flags |= INCFS_BLOCK_COMPRESSED_LZ4;
+		break;
+	case COMPRESSION_ZSTD:
+		flags |= INCFS_BLOCK_COMPRESSED_ZSTD;
+		break;
+	default:
+		return -EINVAL;
+	}
 
 	error = mutex_lock_interruptible(&segment->blockmap_mutex);
 	if (error)
@@ -1018,11 +1519,16 @@ int incfs_process_new_data_block(struct data_file *df,
 	if (!error) {
 		error = incfs_write_data_block_to_backing_file(
 			bfc, range(data, block->data_len), block->block_index,
-			df->df_blockmap_off, flags);
+			df->df_blockmap_off, flags, &bme);
 		mutex_unlock(&bfc->bc_mutex);
 	}
-	if (!error)
+	if (!error) {
+		struct data_file_block new_block;
+
+		convert_data_file_block(&bme, &new_block);
+		blockmap_cache_set(df, block->block_index, &new_block);
 		notify_pending_reads(mi, segment, block->block_index);
+	}
 
 unlock:
 	mutex_unlock(&segment->blockmap_mutex);
@@ -1152,6 +1658,7 @@ static int process_file_signature_md(struct incfs_file_signature *sg,
 		kzalloc(sizeof(*signature), GFP_NOFS);
 	void *buf = NULL;
 	ssize_t read;
+	unsigned int nofs_flags;
 
 	if (!signature)
 		return -ENOMEM;
@@ -1208,6 +1715,19 @@ static int process_file_signature_md(struct incfs_file_signature *sg,
 	df->df_hash_tree = hash_tree;
 	hash_tree = NULL;
 	df->df_signature = signature;
+	/*
+	 * The verified hash cache is optional, reads work without it. Large
+	 * trees need more than a few pages of slots, so allow vmalloc, which
+	 * only takes GFP_KERNEL.
+	 */
+	if (signature->hash_size > 0) {
+		nofs_flags = memalloc_nofs_save();
+		df->df_hash_pages = kvmalloc_array(
+			signature->hash_size / INCFS_DATA_FILE_BLOCK_SIZE,
+			sizeof(*df->df_hash_pages),
+			GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN);
+		memalloc_nofs_restore(nofs_flags);
+	}
 	signature = NULL;
 out:
 	incfs_free_mtree(hash_tree);
@@ -20,6 +20,9 @@
 
 #define SEGMENTS_PER_FILE 3
 
+/* Most blocks incfs_read_data_file_blocks() reads in one go */
+#define INCFS_READ_BATCH_MAX 16
+
 enum LOG_RECORD_TYPE {
 	FULL,
 	SAME_FILE,
@@ -204,6 +207,8 @@ struct file_attr {
 };
 
 
+struct blockmap_cache_chunk;
+
 struct data_file {
 	struct backing_file_context *df_backing_file_context;
 
@@ -240,6 +245,25 @@ struct data_file {
 	struct mtree *df_hash_tree;
 
 	struct incfs_df_signature *df_signature;
+
+	/*
+	 * In-memory copy of the blockmap entries of present data blocks,
+	 * allocated in chunks as blocks are looked up or written. Lookups are
+	 * lockless. NULL if the chunk table couldn't be allocated.
+	 */
+	struct blockmap_cache_chunk **df_bmc_chunks;
+
+	/*
+	 * Pinned copies of the hash tree blocks verified so far, one slot per
+	 * block of the hash tree area. NULL if it couldn't be allocated.
+	 */
+	struct page **df_hash_pages;
+
+	/*
+	 * Number of open files of the inode. The pins in df_hash_pages are
+	 * dropped when the last one is released. Protected by the inode lock.
+	 */
+	int df_open_count;
 };
 
 struct dir_file {
@@ -283,6 +307,13 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 				   int index, int timeout_ms,
 				   struct mem_range tmp);
 
+int incfs_read_data_file_blocks(struct file *f, int first_index,
+				struct mem_range *dst, int nr);
+
+void incfs_free_zstd_workspaces(void);
+
+void incfs_get_hash_cache_stats(unsigned long *hits, unsigned long *misses);
+
 int incfs_get_filled_blocks(struct data_file *df,
 			    struct incfs_get_filled_blocks_args *arg);
 
@@ -363,6 +394,11 @@ int make_inode_ready_for_data_ops(struct mount_info *mi,
 				struct inode *inode,
 				struct file *backing_file);
 
+/*
+ * Undo make_inode_ready_for_data_ops() when a file of the inode is released.
+ */
+void release_inode_data_ops(struct inode *inode);
+
 static inline struct dentry_info *get_incfs_dentry(const struct dentry *d)
 {
 	if (!d)
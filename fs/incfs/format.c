@@ -397,7 +397,8 @@ int incfs_write_fh_to_backing_file(struct backing_file_context *bfc,
 /* Write a given data block and update file's blockmap to point it. */
 int incfs_write_data_block_to_backing_file(struct backing_file_context *bfc,
 				     struct mem_range block, int block_index,
-				     loff_t bm_base_off, u16 flags)
+				     loff_t bm_base_off, u16 flags,
+				     struct incfs_blockmap_entry *bme_out)
 {
 	struct incfs_blockmap_entry bm_entry = {};
 	int result = 0;
@@ -430,8 +431,10 @@ int incfs_write_data_block_to_backing_file(struct backing_file_context *bfc,
 	bm_entry.me_data_size = cpu_to_le16((u16)block.len);
 	bm_entry.me_flags = cpu_to_le16(flags);
 
-	return write_to_bf(bfc, &bm_entry, sizeof(bm_entry),
-				bm_entry_off);
+	result = write_to_bf(bfc, &bm_entry, sizeof(bm_entry), bm_entry_off);
+	if (!result && bme_out)
+		*bme_out = bm_entry;
+	return result;
 }
 
 int incfs_write_hash_block_to_backing_file(struct backing_file_context *bfc,
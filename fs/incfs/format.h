@@ -183,6 +183,7 @@ struct incfs_file_header {
 enum incfs_block_map_entry_flags {
 	INCFS_BLOCK_COMPRESSED_LZ4 = (1 << 0),
 	INCFS_BLOCK_HASH = (1 << 1),
+	INCFS_BLOCK_COMPRESSED_ZSTD = (1 << 2),
 };
 
 /* Block map entry pointing to an actual location of the data block. */
@@ -306,7 +307,8 @@ int incfs_write_fh_to_backing_file(struct backing_file_context *bfc,
 int incfs_write_data_block_to_backing_file(struct backing_file_context *bfc,
 					   struct mem_range block,
 					   int block_index, loff_t bm_base_off,
-					   u16 flags);
+					   u16 flags,
+					   struct incfs_blockmap_entry *bme_out);
 
 int incfs_write_hash_block_to_backing_file(struct backing_file_context *bfc,
 					   struct mem_range block,
@@ -8,6 +8,7 @@
 
 #include <uapi/linux/incrementalfs.h>
 
+#include "data_mgmt.h"
 #include "vfs.h"
 
 #define INCFS_NODE_FEATURES "features"
@@ -39,9 +40,18 @@ static ssize_t mounter_context_for_backing_rw_show(struct kobject *kobj,
 static struct kobj_attribute mounter_context_for_backing_rw_attr =
 	__ATTR_RO(mounter_context_for_backing_rw);
 
+static ssize_t zstd_show(struct kobject *kobj,
+			 struct kobj_attribute *attr, char *buff)
+{
+	return snprintf(buff, PAGE_SIZE, "supported\n");
+}
+
+static struct kobj_attribute zstd_attr = __ATTR_RO(zstd);
+
 static struct attribute *attributes[] = {
 	&corefs_attr.attr,
 	&mounter_context_for_backing_rw_attr.attr,
+	&zstd_attr.attr,
 	NULL,
 };
 
@@ -49,6 +59,41 @@ static const struct attribute_group attr_group = {
 	.attrs = attributes,
 };
 
+static ssize_t hash_cache_hits_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buff)
+{
+	unsigned long hits, misses;
+
+	incfs_get_hash_cache_stats(&hits, &misses);
+	return snprintf(buff, PAGE_SIZE, "%lu\n", hits);
+}
+
+static struct kobj_attribute hash_cache_hits_attr =
+	__ATTR_RO(hash_cache_hits);
+
+static ssize_t hash_cache_misses_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buff)
+{
+	unsigned long hits, misses;
+
+	incfs_get_hash_cache_stats(&hits, &misses);
+	return snprintf(buff, PAGE_SIZE, "%lu\n", misses);
+}
+
+static struct kobj_attribute hash_cache_misses_attr =
+	__ATTR_RO(hash_cache_misses);
+
+static struct attribute *stats_attributes[] = {
+	&hash_cache_hits_attr.attr,
+	&hash_cache_misses_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group stats_attr_group = {
+	.name = "stats",
+	.attrs = stats_attributes,
+};
+
 static int __init init_sysfs(void)
 {
 	int res = 0;
@@ -66,6 +111,16 @@ static int __init init_sysfs(void)
 	if (res) {
 		kobject_put(sysfs_root);
 		sysfs_root = NULL;
+		return res;
+	}
+
+	res = sysfs_create_group(sysfs_root, &stats_attr_group);
+	if (res) {
+		sysfs_remove_group(featurefs_root, &attr_group);
+		kobject_put(featurefs_root);
+		featurefs_root = NULL;
+		kobject_put(sysfs_root);
+		sysfs_root = NULL;
 	}
 	return res;
 }
@@ -79,6 +134,7 @@ static void cleanup_sysfs(void)
 	}
 
 	if (sysfs_root) {
+		sysfs_remove_group(sysfs_root, &stats_attr_group);
 		kobject_put(sysfs_root);
 		sysfs_root = NULL;
 	}
@@ -103,6 +159,7 @@ static void __exit cleanup_incfs_module(void)
 {
 	cleanup_sysfs();
 	unregister_filesystem(&incfs_fs_type);
+	incfs_free_zstd_workspaces();
 }
 
 module_init(init_incfs_module);
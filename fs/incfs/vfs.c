@@ -9,6 +9,7 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/fs_stack.h>
+#include <linux/mm_inline.h>
 #include <linux/namei.h>
 #include <linux/parser.h>
 #include <linux/poll.h>
@@ -53,6 +54,8 @@ static int dir_rename(struct inode *old_dir, struct dentry *old_dentry,
 static int file_open(struct inode *inode, struct file *file);
 static int file_release(struct inode *inode, struct file *file);
 static int read_single_page(struct file *f, struct page *page);
+static int readpages(struct file *f, struct address_space *mapping,
+		     struct list_head *pages, unsigned int nr_pages);
 static long dispatch_ioctl(struct file *f, unsigned int req, unsigned long arg);
 
 static ssize_t pending_reads_read(struct file *f, char __user *buf, size_t len,
@@ -123,7 +126,7 @@ static const struct dentry_operations incfs_dentry_ops = {
 
 static const struct address_space_operations incfs_address_space_ops = {
 	.readpage = read_single_page,
-	/* .readpages = readpages */
+	.readpages = readpages
 };
 
 static const struct file_operations incfs_file_ops = {
@@ -851,6 +854,91 @@ static int read_single_page(struct file *f, struct page *page)
 	return result;
 }
 
+/*
+ * Read a run of consecutive locked pages. Whatever the batched path can't
+ * complete (missing blocks, errors, the tail of the file) goes through
+ * read_single_page() so it behaves exactly as before.
+ */
+static void read_page_batch(struct file *f, struct page **pages, int nr)
+{
+	struct mem_range dst[INCFS_READ_BATCH_MAX];
+	struct data_file *df = get_incfs_data_file(f);
+	int mapped;
+	int done = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		loff_t offset = page_offset(pages[i]);
+
+		if (offset >= df->df_size)
+			break;
+		dst[i] = range(kmap(pages[i]),
+			       min_t(loff_t, df->df_size - offset, PAGE_SIZE));
+	}
+	mapped = i;
+
+	if (mapped > 0) {
+		done = incfs_read_data_file_blocks(f, pages[0]->index, dst,
+						   mapped);
+		if (done < 0)
+			done = 0;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+
+		if (i < done) {
+			if (dst[i].len < PAGE_SIZE)
+				zero_user(page, dst[i].len,
+					  PAGE_SIZE - dst[i].len);
+			SetPageUptodate(page);
+			flush_dcache_page(page);
+		}
+
+		if (i < mapped)
+			kunmap(page);
+
+		if (i < done)
+			unlock_page(page);
+		else
+			read_single_page(f, page);
+		put_page(page);
+	}
+}
+
+static int readpages(struct file *f, struct address_space *mapping,
+		     struct list_head *pages, unsigned int nr_pages)
+{
+	struct page *batch[INCFS_READ_BATCH_MAX];
+	int nr = 0;
+	unsigned int i;
+
+	if (!get_incfs_data_file(f))
+		return -EBADF;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = lru_to_page(pages);
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					  readahead_gfp_mask(mapping))) {
+			put_page(page);
+			continue;
+		}
+
+		if (nr == INCFS_READ_BATCH_MAX ||
+		    (nr > 0 && batch[nr - 1]->index + 1 != page->index)) {
+			read_page_batch(f, batch, nr);
+			nr = 0;
+		}
+		batch[nr++] = page;
+	}
+
+	if (nr > 0)
+		read_page_batch(f, batch, nr);
+	return 0;
+}
+
 static char *file_id_to_str(incfs_uuid_t id)
 {
 	char *result = kmalloc(1 + sizeof(id.bytes) * 2, GFP_NOFS);
@@ -1955,9 +2043,8 @@ static int file_open(struct inode *inode, struct file *file)
 static int file_release(struct inode *inode, struct file *file)
 {
 	if (S_ISREG(inode->i_mode)) {
-		/* Do nothing.
-		 * data_file is released only by inode eviction.
-		 */
+		/* data_file itself is released only by inode eviction. */
+		release_inode_data_ops(inode);
 	} else if (S_ISDIR(inode->i_mode)) {
 		struct dir_file *dir = get_incfs_dir_file(file);
 
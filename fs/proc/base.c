@@ -95,6 +95,7 @@
 #include <linux/flex_array.h>
 #include <linux/posix-timers.h>
 #include <linux/cpufreq_times.h>
+#include <linux/simple_lmk.h>
 #ifdef CONFIG_HARDWALL
 #include <asm/hardwall.h>
 #endif
@@ -1052,9 +1053,11 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 	if (!legacy && has_capability_noaudit(current, CAP_SYS_RESOURCE))
 		task->signal->oom_score_adj_min = (short)oom_adj;
 	trace_oom_score_adj_update(task);
+	simple_lmk_adj_changed(task);
 
 	if (mm) {
 		struct task_struct *p;
+		bool shared;
 
 		rcu_read_lock();
 		for_each_process(p) {
@@ -1066,12 +1069,15 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 				continue;
 
 			task_lock(p);
-			if (!p->vfork_done && process_shares_mm(p, mm)) {
+			shared = !p->vfork_done && process_shares_mm(p, mm);
+			if (shared) {
 				p->signal->oom_score_adj = oom_adj;
 				if (!legacy && has_capability_noaudit(current, CAP_SYS_RESOURCE))
 					p->signal->oom_score_adj_min = (short)oom_adj;
 			}
 			task_unlock(p);
+			if (shared)
+				simple_lmk_adj_changed(p);
 		}
 		rcu_read_unlock();
 		mmdrop(mm);
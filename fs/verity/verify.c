@@ -10,6 +10,7 @@
 #include <crypto/hash.h>
 #include <linux/bio.h>
 #include <linux/ratelimit.h>
+#include <linux/scatterlist.h>
 
 static struct workqueue_struct *fsverity_read_workqueue;
 
@@ -67,7 +68,8 @@ static inline int cmp_hashes(const struct fsverity_info *vi,
 }
 
 /*
- * Verify a single data page against the file's Merkle tree.
+ * Get the level-0 hash page covering data page @index, verified against the
+ * file's Merkle tree.
  *
  * In principle, we need to verify the entire path to the root node.  However,
  * for efficiency the filesystem may cache the hash pages.  Therefore we need
@@ -81,15 +83,18 @@ static inline int cmp_hashes(const struct fsverity_info *vi,
  * Note that multiple processes may race to verify a hash page and mark it
  * Checked, but it doesn't matter; the result will be the same either way.
  *
- * Return: true if the page is valid, else false.
+ * The tree must have at least one level.
+ *
+ * Return: the hash page with PageChecked set, which the caller must put; or an
+ *	   ERR_PTR() on failure
  */
-static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
-			struct ahash_request *req, struct page *data_page,
-			unsigned long level0_ra_pages)
+static struct page *verify_hash_path(struct inode *inode,
+				     const struct fsverity_info *vi,
+				     struct ahash_request *req, pgoff_t index,
+				     unsigned long level0_ra_pages)
 {
 	const struct merkle_tree_params *params = &vi->tree_params;
 	const unsigned int hsize = params->digest_size;
-	const pgoff_t index = data_page->index;
 	int level;
 	u8 _want_hash[FS_VERITY_MAX_DIGEST_SIZE];
 	const u8 *want_hash;
@@ -98,11 +103,6 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 	unsigned int hoffsets[FS_VERITY_MAX_LEVELS];
 	int err;
 
-	if (WARN_ON_ONCE(!PageLocked(data_page) || PageUptodate(data_page)))
-		return false;
-
-	pr_debug_ratelimited("Verifying data page %lu...\n", index);
-
 	/*
 	 * Starting at the leaf level, ascend the tree saving hash pages along
 	 * the way until we find a verified hash page, indicated by PageChecked;
@@ -129,6 +129,8 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 		}
 
 		if (PageChecked(hpage)) {
+			if (level == 0)
+				return hpage;
 			extract_hash(hpage, hoffset, hsize, _want_hash);
 			want_hash = _want_hash;
 			put_page(hpage);
@@ -158,23 +160,68 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 		if (err)
 			goto out;
 		SetPageChecked(hpage);
+		if (level == 1)
+			return hpage;
 		extract_hash(hpage, hoffset, hsize, _want_hash);
 		want_hash = _want_hash;
 		put_page(hpage);
 		pr_debug("Verified hash page at level %d, now want %s:%*phN\n",
 			 level - 1, params->hash_alg->name, hsize, want_hash);
 	}
-
-	/* Finally, verify the data page */
-	err = fsverity_hash_page(params, inode, req, data_page, real_hash);
-	if (err)
-		goto out;
-	err = cmp_hashes(vi, want_hash, real_hash, index, -1);
+	/* Not reached: level 0 either was Checked or got verified above */
+	err = -EINVAL;
 out:
 	for (; level > 0; level--)
 		put_page(hpages[level - 1]);
 
-	return err == 0;
+	return ERR_PTR(err);
+}
+
+/*
+ * Verify a single data page against the file's Merkle tree.
+ *
+ * Return: true if the page is valid, else false.
+ */
+static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
+			struct ahash_request *req, struct page *data_page,
+			unsigned long level0_ra_pages)
+{
+	const struct merkle_tree_params *params = &vi->tree_params;
+	const unsigned int hsize = params->digest_size;
+	const pgoff_t index = data_page->index;
+	u8 _want_hash[FS_VERITY_MAX_DIGEST_SIZE];
+	const u8 *want_hash;
+	u8 real_hash[FS_VERITY_MAX_DIGEST_SIZE];
+	int err;
+
+	if (WARN_ON_ONCE(!PageLocked(data_page) || PageUptodate(data_page)))
+		return false;
+
+	pr_debug_ratelimited("Verifying data page %lu...\n", index);
+
+	if (params->num_levels == 0) {
+		/* Single-block file: the root hash is the data block's hash */
+		want_hash = vi->root_hash;
+	} else {
+		struct page *hpage;
+		pgoff_t hindex;
+		unsigned int hoffset;
+
+		hpage = verify_hash_path(inode, vi, req, index,
+					 level0_ra_pages);
+		if (IS_ERR(hpage))
+			return false;
+		hash_at_level(params, index, 0, &hindex, &hoffset);
+		extract_hash(hpage, hoffset, hsize, _want_hash);
+		want_hash = _want_hash;
+		put_page(hpage);
+	}
+
+	/* Finally, verify the data page */
+	err = fsverity_hash_page(params, inode, req, data_page, real_hash);
+	if (err)
+		return false;
+	return cmp_hashes(vi, want_hash, real_hash, index, -1) == 0;
 }
 
 /**
@@ -205,6 +252,123 @@ bool fsverity_verify_page(struct page *page)
 EXPORT_SYMBOL_GPL(fsverity_verify_page);
 
 #ifdef CONFIG_BLOCK
+/* Maximum number of data pages the bio verifier keeps hashing at once */
+#define FS_VERITY_MAX_PENDING_HASHES	4
+
+struct verify_slot {
+	struct ahash_request *req;
+	struct scatterlist sg;
+	struct crypto_wait wait;
+	u8 real_hash[FS_VERITY_MAX_DIGEST_SIZE];
+};
+
+/*
+ * Verify @nr data pages sharing one level-0 hash page.  The path from that hash
+ * page to the root is verified once for the whole group, then the data pages
+ * are hashed with up to @nr_slots requests in flight and compared against the
+ * hashes in the one hash page.  Pages that fail are set to the Error state.
+ */
+static void verify_page_group(struct inode *inode,
+			      const struct fsverity_info *vi,
+			      struct verify_slot *slots, unsigned int nr_slots,
+			      struct bio_vec *bvecs, unsigned int nr,
+			      unsigned long level0_ra_pages)
+{
+	const struct merkle_tree_params *params = &vi->tree_params;
+	const unsigned int hsize = params->digest_size;
+	int ret[FS_VERITY_MAX_PENDING_HASHES];
+	struct page *hpage;
+	unsigned int i, j, n;
+
+	hpage = verify_hash_path(inode, vi, slots[0].req,
+				 bvecs[0].bv_page->index, level0_ra_pages);
+	if (IS_ERR(hpage)) {
+		for (i = 0; i < nr; i++)
+			SetPageError(bvecs[i].bv_page);
+		return;
+	}
+
+	for (i = 0; i < nr; i += n) {
+		n = min(nr - i, nr_slots);
+
+		for (j = 0; j < n; j++) {
+			struct page *page = bvecs[i + j].bv_page;
+
+			if (WARN_ON_ONCE(!PageLocked(page) ||
+					 PageUptodate(page))) {
+				SetPageError(page);
+				ret[j] = 1;	/* skipped */
+				continue;
+			}
+			ret[j] = fsverity_hash_page_start(params, inode,
+							  slots[j].req,
+							  &slots[j].sg,
+							  &slots[j].wait, page,
+							  slots[j].real_hash);
+		}
+
+		for (j = 0; j < n; j++) {
+			struct page *page = bvecs[i + j].bv_page;
+			u8 want_hash[FS_VERITY_MAX_DIGEST_SIZE];
+			pgoff_t hindex;
+			unsigned int hoffset;
+			int err;
+
+			if (ret[j] > 0)
+				continue;
+			err = crypto_wait_req(ret[j], &slots[j].wait);
+			if (err) {
+				fsverity_err(inode,
+					     "Error %d computing page hash", err);
+				SetPageError(page);
+				continue;
+			}
+			hash_at_level(params, page->index, 0, &hindex, &hoffset);
+			extract_hash(hpage, hoffset, hsize, want_hash);
+			if (cmp_hashes(vi, want_hash, slots[j].real_hash,
+				       page->index, -1))
+				SetPageError(page);
+		}
+	}
+
+	put_page(hpage);
+}
+
+struct verify_prefetch {
+	struct work_struct work;
+	struct inode *inode;
+	pgoff_t first;
+	pgoff_t last;
+};
+
+/*
+ * Read in the level 1 and higher hash pages covering a bio, so that when the
+ * verifier ascends the tree they are already cached or in flight, instead of
+ * being read one level at a time.
+ */
+static void verify_prefetch_fn(struct work_struct *work)
+{
+	struct verify_prefetch *pf =
+		container_of(work, struct verify_prefetch, work);
+	struct inode *inode = pf->inode;
+	const struct merkle_tree_params *params =
+		&inode->i_verity_info->tree_params;
+	unsigned int level;
+
+	for (level = 1; level < params->num_levels; level++) {
+		pgoff_t first, last;
+		unsigned int hoffset;
+		struct page *hpage;
+
+		hash_at_level(params, pf->first, level, &first, &hoffset);
+		hash_at_level(params, pf->last, level, &last, &hoffset);
+		hpage = inode->i_sb->s_vop->read_merkle_tree_page(inode, first,
+							last - first + 1);
+		if (!IS_ERR(hpage))
+			put_page(hpage);
+	}
+}
+
 /**
  * fsverity_verify_bio() - verify a 'read' bio that has just completed
  * @bio: the bio to verify
@@ -214,6 +378,9 @@ EXPORT_SYMBOL_GPL(fsverity_verify_page);
  * that fail verification are set to the Error state.  Verification is skipped
  * for pages already in the Error state, e.g. due to fscrypt decryption failure.
  *
+ * Consecutive pages that share a level-0 hash page are verified as a group, so
+ * the hash page is looked up and its path checked only once per group.
+ *
  * This is a helper function for use by the ->readpages() method of filesystems
  * that issue bios to read data directly into the page cache.  Filesystems that
  * populate the page cache without issuing bios (e.g. non block-based
@@ -225,13 +392,29 @@ void fsverity_verify_bio(struct bio *bio)
 	struct inode *inode = bio->bi_io_vec->bv_page->mapping->host;
 	const struct fsverity_info *vi = inode->i_verity_info;
 	const struct merkle_tree_params *params = &vi->tree_params;
-	struct ahash_request *req;
-	struct bio_vec *bv;
-	int i;
+	struct verify_slot slots[FS_VERITY_MAX_PENDING_HASHES];
+	unsigned int nr_slots = 1;
+	struct verify_prefetch pf;
+	bool prefetch = false;
+	unsigned int i, j;
 	unsigned long max_ra_pages = 0;
 
 	/* This allocation never fails, since it's mempool-backed. */
-	req = fsverity_alloc_hash_request(params->hash_alg, GFP_NOFS);
+	slots[0].req = fsverity_alloc_hash_request(params->hash_alg, GFP_NOFS);
+
+	/*
+	 * Further requests only let several pages be hashed at once.  Nothing
+	 * depends on them for forward progress, so never wait for one.
+	 */
+	while (nr_slots < min_t(unsigned int, bio->bi_vcnt,
+				FS_VERITY_MAX_PENDING_HASHES)) {
+		slots[nr_slots].req =
+			fsverity_alloc_hash_request(params->hash_alg,
+						    GFP_NOWAIT);
+		if (!slots[nr_slots].req)
+			break;
+		nr_slots++;
+	}
 
 	if (bio->bi_opf & REQ_RAHEAD) {
 		/*
@@ -243,23 +426,59 @@ void fsverity_verify_bio(struct bio *bio)
 		 * This improves sequential read performance, as it greatly
 		 * reduces the number of I/O requests made to the Merkle tree.
 		 */
-		bio_for_each_segment_all(bv, bio, i)
-			max_ra_pages++;
-		max_ra_pages /= 4;
+		max_ra_pages = bio->bi_vcnt / 4;
+
+		/*
+		 * The upper levels are read in parallel with the first level,
+		 * rather than one after another as the tree is ascended.
+		 */
+		if (params->num_levels > 1) {
+			pf.inode = inode;
+			pf.first = bio->bi_io_vec[0].bv_page->index;
+			pf.last = bio->bi_io_vec[bio->bi_vcnt - 1].bv_page->index;
+			if (pf.last < pf.first)
+				swap(pf.first, pf.last);
+			INIT_WORK_ONSTACK(&pf.work, verify_prefetch_fn);
+			queue_work(system_unbound_wq, &pf.work);
+			prefetch = true;
+		}
 	}
 
-	bio_for_each_segment_all(bv, bio, i) {
-		struct page *page = bv->bv_page;
+	for (i = 0; i < bio->bi_vcnt; i = j) {
+		struct page *page = bio->bi_io_vec[i].bv_page;
 		unsigned long level0_index = page->index >> params->log_arity;
 		unsigned long level0_ra_pages =
 			min(max_ra_pages, params->level0_blocks - level0_index);
 
-		if (!PageError(page) &&
-		    !verify_page(inode, vi, req, page, level0_ra_pages))
-			SetPageError(page);
+		j = i + 1;
+		if (PageError(page))
+			continue;
+
+		if (params->num_levels == 0) {
+			if (!verify_page(inode, vi, slots[0].req, page, 0))
+				SetPageError(page);
+			continue;
+		}
+
+		while (j < bio->bi_vcnt) {
+			struct page *next = bio->bi_io_vec[j].bv_page;
+
+			if (PageError(next) ||
+			    next->index >> params->log_arity != level0_index)
+				break;
+			j++;
+		}
+		verify_page_group(inode, vi, slots, nr_slots,
+				  &bio->bi_io_vec[i], j - i, level0_ra_pages);
+	}
+
+	if (prefetch) {
+		flush_work(&pf.work);
+		destroy_work_on_stack(&pf.work);
 	}
 
-	fsverity_free_hash_request(params->hash_alg, req);
+	for (i = 0; i < nr_slots; i++)
+		fsverity_free_hash_request(params->hash_alg, slots[i].req);
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_bio);
 #endif /* CONFIG_BLOCK */
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM simple_lmk
+
+#if !defined(_TRACE_SIMPLE_LMK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_SIMPLE_LMK_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+TRACE_EVENT(simple_lmk_decision,
+
+	TP_PROTO(int nr_indexed, int nr_found, int nr_to_kill,
+		 unsigned long pages_found, u64 duration_ns),
+
+	TP_ARGS(nr_indexed, nr_found, nr_to_kill, pages_found, duration_ns),
+
+	TP_STRUCT__entry(
+		__field(int, nr_indexed)
+		__field(int, nr_found)
+		__field(int, nr_to_kill)
+		__field(unsigned long, pages_found)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__entry->nr_indexed	= nr_indexed;
+		__entry->nr_found	= nr_found;
+		__entry->nr_to_kill	= nr_to_kill;
+		__entry->pages_found	= pages_found;
+		__entry->duration_ns	= duration_ns;
+	),
+
+	TP_printk("indexed=%d found=%d kill=%d pages=%lu duration_ns=%llu",
+		  __entry->nr_indexed, __entry->nr_found, __entry->nr_to_kill,
+		  __entry->pages_found, __entry->duration_ns)
+);
+
+TRACE_EVENT(simple_lmk_kill,
+
+	TP_PROTO(struct task_struct *tsk, short adj, unsigned long pages),
+
+	TP_ARGS(tsk, adj, pages),
+
+	TP_STRUCT__entry(
+		__array(char, comm, TASK_COMM_LEN)
+		__field(pid_t, pid)
+		__field(short, adj)
+		__field(unsigned long, pages)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, tsk->comm, TASK_COMM_LEN);
+		__entry->pid	= tsk->pid;
+		__entry->adj	= adj;
+		__entry->pages	= pages;
+	),
+
+	TP_printk("comm=%s pid=%d adj=%hd pages=%lu",
+		  __entry->comm, __entry->pid, __entry->adj, __entry->pages)
+);
+
+#endif /* _TRACE_SIMPLE_LMK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
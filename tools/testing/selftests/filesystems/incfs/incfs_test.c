@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/mount.h>
@@ -2668,6 +2669,128 @@ static int large_file(char *mount_dir)
 	return result;
 }
 
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int timed_read(char *mount_dir, struct test_file *file,
+		      const char *label)
+{
+	char *filename = concat_file_name(mount_dir, file->name);
+	double start = now_s();
+	loff_t bytes = read_whole_file(filename);
+	double elapsed = now_s() - start;
+
+	free(filename);
+	if (bytes != file->size) {
+		ksft_print_msg("Short read of %s: %lld\n", file->name,
+			       (long long)bytes);
+		return -EIO;
+	}
+
+	ksft_print_msg("%s: %lld bytes in %.3fs, %.1f MB/s\n", label,
+		       (long long)bytes, elapsed,
+		       bytes / (1024.0 * 1024.0) / (elapsed > 0 ? elapsed : 1));
+	return 0;
+}
+
+/*
+ * Sequential read throughput of a fully populated file with a hash tree,
+ * once through the single block path (readahead disabled) and once through
+ * readahead. Blocks are written in order so the batched path sees long
+ * backing file runs.
+ */
+static int sequential_read_perf_test(char *mount_dir)
+{
+	char *backing_dir;
+	struct test_file file = {
+		.index = 11,
+		.name = "file_sequential",
+		.size = 64 * 1024 * 1024,
+	};
+	int block_cnt = file.size / INCFS_DATA_FILE_BLOCK_SIZE;
+	int *block_indexes = NULL;
+	int cmd_fd = -1;
+	int i;
+	int res;
+
+	backing_dir = create_backing_dir(mount_dir);
+	if (!backing_dir)
+		goto failure;
+
+	if (mount_fs_opt(mount_dir, backing_dir, "readahead=0", false) != 0)
+		goto failure;
+
+	cmd_fd = open_commands_file(mount_dir);
+	if (cmd_fd < 0)
+		goto failure;
+
+	build_mtree(&file);
+	if (crypto_emit_file(cmd_fd, NULL, file.name, &file.id, file.size,
+			     file.root_hash, file.sig.add_data) < 0)
+		goto failure;
+
+	block_indexes = calloc(block_cnt, sizeof(*block_indexes));
+	if (!block_indexes)
+		goto failure;
+	for (i = 0; i < block_cnt; i++)
+		block_indexes[i] = i;
+
+	for (i = 0; i < block_cnt; i += res) {
+		res = emit_test_blocks(mount_dir, &file, block_indexes + i,
+				       block_cnt - i);
+		if (res <= 0)
+			goto failure;
+	}
+
+	res = load_hash_tree(mount_dir, &file);
+	if (res) {
+		ksft_print_msg("Can't load hashes for %s. error: %s\n",
+			       file.name, strerror(-res));
+		goto failure;
+	}
+
+	/* Remount between runs so every read starts with a cold page cache */
+	close(cmd_fd);
+	cmd_fd = -1;
+	if (umount(mount_dir) != 0)
+		goto failure;
+	if (mount_fs_opt(mount_dir, backing_dir, "readahead=0", false) != 0)
+		goto failure;
+	if (timed_read(mount_dir, &file, "no readahead"))
+		goto failure;
+
+	if (umount(mount_dir) != 0)
+		goto failure;
+	if (mount_fs_opt(mount_dir, backing_dir, "readahead=64", false) != 0)
+		goto failure;
+	if (timed_read(mount_dir, &file, "readahead"))
+		goto failure;
+
+	if (validate_test_file_content(mount_dir, &file) < 0)
+		goto failure;
+
+	if (umount(mount_dir) != 0)
+		goto failure;
+
+	free(block_indexes);
+	free(file.mtree);
+	free(backing_dir);
+	return TEST_SUCCESS;
+
+failure:
+	free(block_indexes);
+	free(file.mtree);
+	close(cmd_fd);
+	umount(mount_dir);
+	free(backing_dir);
+	return TEST_FAILURE;
+}
+
 static char *setup_mount_dir()
 {
 	struct stat st;
@@ -2738,6 +2861,7 @@ int main(int argc, char *argv[])
 		MAKE_TEST(get_blocks_test),
 		MAKE_TEST(get_hash_blocks_test),
 		MAKE_TEST(large_file),
+		MAKE_TEST(sequential_read_perf_test),
 	};
 #undef MAKE_TEST
 
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Sequential read throughput of an fs-verity file with a cold page cache,
+ * i.e. including Merkle tree reads and data page verification.
+ *
+ * Usage: verity_read_perf [dir]
+ *
+ * dir must be on a filesystem with verity enabled (e.g. ext4 with the
+ * "verity" feature); it defaults to the current directory.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <linux/fsverity.h>
+
+#include <kselftest.h>
+
+#define FILE_SIZE	(64 * 1024 * 1024)
+#define CHUNK_SIZE	(1024 * 1024)
+#define NR_RUNS		5
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int create_file(const char *path, char *buf)
+{
+	int fd, i;
+	unsigned int seed = 1;
+
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+	if (fd < 0)
+		return -errno;
+
+	for (i = 0; i < FILE_SIZE / CHUNK_SIZE; i++) {
+		int j;
+
+		for (j = 0; j < CHUNK_SIZE; j++)
+			buf[j] = rand_r(&seed);
+		if (write(fd, buf, CHUNK_SIZE) != CHUNK_SIZE)
+			goto err;
+	}
+	if (fsync(fd))
+		goto err;
+	close(fd);
+	return 0;
+
+err:
+	close(fd);
+	return -errno;
+}
+
+static int enable_verity(const char *path)
+{
+	struct fsverity_enable_arg arg = {
+		.version = 1,
+		.hash_algorithm = FS_VERITY_HASH_ALG_SHA256,
+		.block_size = 4096,
+	};
+	int fd, err = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	if (ioctl(fd, FS_IOC_ENABLE_VERITY, &arg))
+		err = -errno;
+	close(fd);
+	return err;
+}
+
+/* Drop the file's data and Merkle tree pages from the page cache */
+static void drop_caches(int fd)
+{
+	int dc;
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	dc = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (dc >= 0) {
+		sync();
+		if (write(dc, "3", 1) != 1)
+			ksft_print_msg("Can't drop caches: %s\n",
+				       strerror(errno));
+		close(dc);
+	}
+}
+
+static int timed_read(const char *path, char *buf, double *mbps)
+{
+	double start, elapsed;
+	ssize_t res;
+	size_t total = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	drop_caches(fd);
+
+	start = now_s();
+	while ((res = read(fd, buf, CHUNK_SIZE)) > 0)
+		total += res;
+	elapsed = now_s() - start;
+	close(fd);
+
+	if (res < 0)
+		return -errno;
+	if (total != FILE_SIZE)
+		return -EIO;
+
+	*mbps = total / (1024.0 * 1024.0) / elapsed;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = argc > 1 ? argv[1] : ".";
+	char path[PATH_MAX];
+	double mbps, best = 0, sum = 0;
+	char *buf;
+	int err, i;
+
+	ksft_print_header();
+
+	if (geteuid() != 0)
+		ksft_print_msg("Not a root, page cache may stay warm.\n");
+
+	buf = malloc(CHUNK_SIZE);
+	if (!buf)
+		ksft_exit_fail_msg("Out of memory\n");
+
+	snprintf(path, sizeof(path), "%s/verity_read_perf.tmp", dir);
+	err = create_file(path, buf);
+	if (err)
+		ksft_exit_fail_msg("Can't create %s: %s\n", path,
+				   strerror(-err));
+
+	err = enable_verity(path);
+	if (err) {
+		unlink(path);
+		if (err == -EOPNOTSUPP || err == -ENOTTY)
+			ksft_exit_skip("fs-verity not supported on %s\n", dir);
+		ksft_exit_fail_msg("Can't enable verity: %s\n",
+				   strerror(-err));
+	}
+
+	for (i = 0; i < NR_RUNS; i++) {
+		err = timed_read(path, buf, &mbps);
+		if (err) {
+			unlink(path);
+			ksft_exit_fail_msg("Read failed: %s\n",
+					   strerror(-err));
+		}
+		ksft_print_msg("run %d: %.1f MB/s\n", i, mbps);
+		sum += mbps;
+		if (mbps > best)
+			best = mbps;
+	}
+
+	ksft_print_msg("verified sequential read: avg %.1f MB/s, best %.1f MB/s\n",
+		       sum / NR_RUNS, best);
+
+	unlink(path);
+	free(buf);
+	ksft_test_result_pass("verity_read_perf\n");
+	ksft_exit_pass();
+	return 0;
+}